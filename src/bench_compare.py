@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+"""Compare two --bench result files and flag regressions.
+
+    ./car_game --bench > new.json
+    python3 bench_compare.py old.json new.json [--threshold 10]
+
+Prints old and new time per iteration and the change for every benchmark
+in both files. Exits with status 1 if any got slower by more than the
+threshold (percent). Google Benchmark JSON files work too; when they hold
+repetitions, only the median aggregate is compared.
+"""
+
+import argparse
+import json
+import sys
+
+UNIT_NS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    times = {}
+    for bench in data.get("benchmarks", []):
+        if bench.get("run_type") == "aggregate" and bench.get("aggregate_name") != "median":
+            continue
+        name = bench.get("run_name", bench["name"])
+        times[name] = bench["real_time"] * UNIT_NS[bench.get("time_unit", "ns")]
+    return times
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="percent slowdown that counts as a regression (default 10)")
+    args = parser.parse_args()
+
+    old, new = load(args.old), load(args.new)
+    names = [name for name in new if name in old]
+    width = max([len(name) for name in set(old) | set(new)] + [9])
+    print(f"{'benchmark':<{width}}  {'old ns':>12}  {'new ns':>12}  {'change':>8}")
+    regressions = 0
+    for name in names:
+        change = (new[name] - old[name]) / old[name] * 100 if old[name] else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print(f"{name:<{width}}  {old[name]:>12.1f}  {new[name]:>12.1f}  {change:>+7.1f}%{flag}")
+    for name in sorted(set(old) ^ set(new)):
+        print(f"{name:<{width}}  only in {'old' if name in old else 'new'}")
+    if regressions:
+        print(f"{regressions} benchmark(s) slower by more than {args.threshold:g}%")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,68 @@
+// C API for driving batches of headless games from other languages (see
+// cargame_env.py). Build main.cpp as a shared library with CARGAME_LIBRARY
+// defined; the game's own main() is then left out:
+//
+//   g++ -std=c++17 -O2 -pthread -fPIC -shared -fvisibility=hidden -DCARGAME_LIBRARY -o libcargame.so main.cpp
+//
+// A batch holds `count` independent games of the classic 20x20 track. All
+// buffers belong to the batch, stay at the same address for its lifetime and
+// are rewritten in place by cargame_reset() and cargame_step(), so callers
+// can wrap them once (as numpy arrays, say) and read them after every step.
+
+#ifndef CARGAME_H
+#define CARGAME_H
+
+#include <stdint.h>
+
+#if !defined(_WIN32)
+    #define CARGAME_API __attribute__((visibility("default")))
+#elif defined(CARGAME_LIBRARY)
+    #define CARGAME_API __declspec(dllexport)
+#else
+    #define CARGAME_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct cargame_batch cargame_batch;
+
+// Observation cells
+#define CARGAME_CELL_ROAD 0
+#define CARGAME_CELL_CAR 1
+#define CARGAME_CELL_PLAYER 2
+
+// NULL if count < 1 or level is not 1..5
+CARGAME_API cargame_batch *cargame_create(int count, int level);
+CARGAME_API void cargame_destroy(cargame_batch *batch);
+
+// Start every game over. Game i draws its spawns from stream i of seed (and
+// later games in its slot from further streams), so a batch is reproducible
+// and a game plays the same whatever the batch size.
+CARGAME_API void cargame_reset(cargame_batch *batch, uint64_t seed);
+
+// Advance every game one tick. actions[i] is -1 (left), 0 or +1 (right) for
+// game i. A game that crashes reports done = 1 and its final score, and is
+// restarted on the spot, so its observation already shows the new game.
+// Returns the number of games that crashed this step.
+CARGAME_API int cargame_step(cargame_batch *batch, const int8_t *actions);
+
+// Occupancy grids, count x rows x cols uint8 cells, row 0 at the top; the
+// player is always on the last row
+CARGAME_API const uint8_t *cargame_observations(const cargame_batch *batch);
+CARGAME_API int cargame_rows(const cargame_batch *batch);
+CARGAME_API int cargame_cols(const cargame_batch *batch);
+CARGAME_API int cargame_count(const cargame_batch *batch);
+
+// Per game, as of the last step: points gained (int32), whether it crashed
+// (uint8), and its score (int64; the final score when it crashed)
+CARGAME_API const int32_t *cargame_rewards(const cargame_batch *batch);
+CARGAME_API const uint8_t *cargame_dones(const cargame_batch *batch);
+CARGAME_API const int64_t *cargame_scores(const cargame_batch *batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+"""ctypes binding for the batched agent API in cargame.h.
+
+The observation, reward, done and score arrays are numpy views of the
+library's own buffers: they are created once and updated in place by every
+reset() and step(), with nothing copied or serialized per step.
+
+    env = CarGameBatch(1024, level=3, library="./libcargame.so")
+    obs = env.reset(seed=1)                    # uint8 (1024, 20, 20), shared
+    obs, rewards, dones = env.step(actions)     # actions: int8 in {-1, 0, 1}
+
+Copy an array (obs.copy()) to keep it past the next step.
+"""
+
+import ctypes
+import os
+
+import numpy as np
+
+CELL_ROAD = 0
+CELL_CAR = 1
+CELL_PLAYER = 2
+
+
+def _load(path):
+    lib = ctypes.CDLL(path)
+    batch = ctypes.c_void_p
+    lib.cargame_create.restype = batch
+    lib.cargame_create.argtypes = [ctypes.c_int, ctypes.c_int]
+    lib.cargame_destroy.restype = None
+    lib.cargame_destroy.argtypes = [batch]
+    lib.cargame_reset.restype = None
+    lib.cargame_reset.argtypes = [batch, ctypes.c_uint64]
+    lib.cargame_step.restype = ctypes.c_int
+    lib.cargame_step.argtypes = [batch, ctypes.POINTER(ctypes.c_int8)]
+    for name in ("cargame_rows", "cargame_cols", "cargame_count"):
+        getattr(lib, name).restype = ctypes.c_int
+        getattr(lib, name).argtypes = [batch]
+    for name, ctype in (("cargame_observations", ctypes.c_uint8),
+                        ("cargame_rewards", ctypes.c_int32),
+                        ("cargame_dones", ctypes.c_uint8),
+                        ("cargame_scores", ctypes.c_int64)):
+        getattr(lib, name).restype = ctypes.POINTER(ctype)
+        getattr(lib, name).argtypes = [batch]
+    return lib
+
+
+def _default_library():
+    name = "cargame.dll" if os.name == "nt" else "libcargame.so"
+    return os.path.join(os.path.dirname(os.path.abspath(__file__)), name)
+
+
+class CarGameBatch:
+    """count independent games on the classic 20x20 track, stepped together."""
+
+    def __init__(self, count, level=1, library=None):
+        self._handle = None  # so __del__ is safe if loading fails
+        self._lib = _load(library or _default_library())
+        self._handle = self._lib.cargame_create(count, level)
+        if not self._handle:
+            raise ValueError("count must be >= 1 and level 1..5")
+        rows = self._lib.cargame_rows(self._handle)
+        cols = self._lib.cargame_cols(self._handle)
+        self.count = count
+        self.observations = np.ctypeslib.as_array(
+            self._lib.cargame_observations(self._handle), shape=(count, rows, cols))
+        self.rewards = np.ctypeslib.as_array(self._lib.cargame_rewards(self._handle), shape=(count,))
+        self.dones = np.ctypeslib.as_array(self._lib.cargame_dones(self._handle), shape=(count,))
+        self.scores = np.ctypeslib.as_array(self._lib.cargame_scores(self._handle), shape=(count,))
+        self._actions = np.zeros(count, dtype=np.int8)
+
+    def reset(self, seed=0):
+        self._lib.cargame_reset(self._handle, seed)
+        return self.observations
+
+    def step(self, actions):
+        """Advance every game one tick; crashed games restart (dones[i] == 1)."""
+        np.copyto(self._actions, actions, casting="unsafe")
+        self._lib.cargame_step(self._handle,
+                               self._actions.ctypes.data_as(ctypes.POINTER(ctypes.c_int8)))
+        return self.observations, self.rewards, self.dones
+
+    def close(self):
+        if self._handle:
+            self._lib.cargame_destroy(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        self.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
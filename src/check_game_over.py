@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""Check that the game over screen is printed below the track.
+
+    python3 check_game_over.py ./car_game [--seeds 5]
+
+Plays one unattended game per seed on a 40x80 pseudo-terminal and follows
+the cursor through the output. Exits with status 1 if "GAME OVER" starts on
+or above the row after the frame (20 track rows, the status and HUD rows),
+or if it overwrote any track row.
+"""
+
+import argparse
+import fcntl
+import os
+import pty
+import re
+import select
+import struct
+import sys
+import termios
+import time
+
+TRACK_ROWS = 20
+FRAME_ROWS = TRACK_ROWS + 2
+TERM_ROWS, TERM_COLS = 40, 80
+
+
+def screen(data):
+    """The screen after data, for the few sequences the game sends."""
+    cells = [[" "] * TERM_COLS for _ in range(TERM_ROWS + 20)]
+    row = col = 0
+    for tok in re.split(rb"(\x1b\[[0-9;?]*[A-Za-z])", data):
+        if tok.startswith(b"\x1b["):
+            move = re.fullmatch(rb"\x1b\[(\d+);(\d+)H", tok)
+            forward = re.fullmatch(rb"\x1b\[(\d+)C", tok)
+            if move:
+                row, col = int(move[1]) - 1, int(move[2]) - 1
+            elif forward:
+                col += int(forward[1])
+            elif tok == b"\x1b[H":
+                row = col = 0
+            elif tok == b"\x1b[2J":
+                cells = [[" "] * TERM_COLS for _ in cells]
+            continue
+        for ch in tok.decode("latin1"):
+            if ch == "\n":
+                row, col = row + 1, 0
+            elif ch == "\r":
+                col = 0
+            elif row < len(cells) and col < TERM_COLS:
+                cells[row][col] = ch
+                col += 1
+    return ["".join(line).rstrip() for line in cells]
+
+
+def play(game, seed):
+    pid, fd = pty.fork()
+    if pid == 0:
+        os.execv(game, [game, "--seed", str(seed)])
+    fcntl.ioctl(fd, termios.TIOCSWINSZ, struct.pack("HHHH", TERM_ROWS, TERM_COLS, 0, 0))
+    out = b""
+
+    def pump(seconds, until=None):
+        nonlocal out
+        end = time.time() + seconds
+        while time.time() < end and not (until and until in out):
+            if select.select([fd], [], [], 0.05)[0]:
+                try:
+                    out += os.read(fd, 65536)
+                except OSError:
+                    return
+
+    pump(0.3)
+    os.write(fd, b"1\n")  # new game; nobody steers, so it soon crashes
+    pump(60, b"GAME OVER")
+    pump(0.2)
+    os.kill(pid, 9)
+    os.waitpid(pid, 0)
+    os.close(fd)
+    return screen(out[out.rfind(b"\x1b[2J"):])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("game")
+    parser.add_argument("--seeds", type=int, default=5)
+    args = parser.parse_args()
+
+    failures = 0
+    for seed in range(1, args.seeds + 1):
+        lines = play(os.path.abspath(args.game), seed)
+        row = next((i + 1 for i, line in enumerate(lines) if "GAME OVER" in line), None)
+        track_intact = all(line.startswith("|") for line in lines[:TRACK_ROWS])
+        ok = row is not None and row > FRAME_ROWS + 1 and track_intact
+        failures += not ok
+        print(f"seed {seed}: GAME OVER on row {row}{'' if ok else '  FAIL'}")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -11,6 +11,24 @@
 #include <sstream>
 #include <iomanip>
 #include <cctype>
+#include <cstdint>
+#include <algorithm>
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <new>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstddef>
+#include <csignal>
+#include <memory>
+#include <unordered_map>
+
+#include "cargame.h"
 
 // Platform-specific headers
 #ifdef _WIN32
@@ -21,48 +39,592 @@
     #include <termios.h>
     #include <sys/ioctl.h>
     #include <sys/select.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/uio.h>
+    #ifdef __linux__
+        #include <sys/epoll.h>
+        #include <sys/socket.h>
+        #include <netinet/in.h>
+        #include <netinet/tcp.h>
+    #endif
+#endif
+
+// SIMD kernels for obstacle scans; define CARGAME_NO_SIMD to force the
+// scalar fallback
+#if !defined(CARGAME_NO_SIMD)
+    #if defined(__AVX2__)
+        #include <immintrin.h>
+        #define CARGAME_SIMD_AVX2 1
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #include <emmintrin.h>
+        #define CARGAME_SIMD_SSE2 1
+    #elif defined(__ARM_NEON) && defined(__aarch64__)
+        #include <arm_neon.h>
+        #define CARGAME_SIMD_NEON 1
+    #endif
 #endif
 
 // --- Configuration ---
 const int TRACK_WIDTH = 20;
 const int SCREEN_HEIGHT = 20;
 const int START_PLAYER_X = TRACK_WIDTH / 2 + 1;
-const std::string HIGHSCORE_FILE = "highscore.txt";
+const std::string HIGHSCORE_FILE = "highscore.txt";   // legacy single score, imported once
+const std::string LEADERBOARD_FILE = "highscores.dat";
 
 const char PLAYER_CHAR = '@';
 const char OBSTACLE_CHAR = '#';
 const char ROAD_CHAR = ' ';
 const char BORDER_CHAR = '|';
+const char OFFROAD_CHAR = '.';
 
 // ANSI Clear screen (works on most modern terminals, and on Windows 10+ when VT is enabled)
 const std::string CLEAR_SCREEN = "\033[2J\033[1;1H";
 
-// --- Global Game State ---
-struct Car { int x; int y; };
+// Frame buffer geometry: track rows, then the status bar and the profiler
+// HUD row. Frames are at least FRAME_COLS wide so the status bar fits.
+const int FRAME_COLS = 80;
+// Unchanged cells shorter than this between two changed runs are rewritten
+// rather than paying for another cursor move
+const int RUN_MERGE_GAP = 6;
+// Most ticks run back to back to catch up after a stall; beyond this the
+// backlog is dropped so a long stall cannot turn into a burst of ticks
+const int MAX_CATCHUP_TICKS = 5;
+// How long exit waits for queued score/replay/profile writes to finish
+const std::chrono::milliseconds IO_FLUSH_TIMEOUT(2000);
+
+// --- Random Numbers ---
+// PCG32 (pcg-random.org): 16 bytes of state and one multiply per draw. Every
+// game owns its generator, so a run is reproducible from its seed and games
+// can be stepped on any thread.
+struct Rng {
+    uint64_t state = 0;
+    uint64_t inc = 1;
+
+    // Distinct streams give independent sequences for the same seed
+    void seed(uint64_t seedValue, uint64_t stream = 0) {
+        state = 0;
+        inc = (stream << 1) | 1;
+        next();
+        state += seedValue;
+        next();
+    }
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+        uint32_t rot = (uint32_t)(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+    // Uniform int in [0, n) by multiply-shift, no division
+    int below(int n) {
+        return (int)(((uint64_t)next() * (uint64_t)n) >> 32);
+    }
+};
+
+// --- Game State ---
+// Cars keep the world row they spawned on and the view scrolls one row per
+// tick, so a car's screen row is derived instead of being advanced.
+//
+// The standard game is templated over its track size. Sizes known at
+// compile time (TrackGame<W, H>) get constant bounds in every loop, so the
+// compiler unrolls them; TrackGame<0, 0> takes its size at run time for any
+// other track. GameState is the classic 20x20 game.
+
+// Largest track any mode accepts: a 300x100 terminal minus the borders and
+// the status and HUD rows
+const int MAX_TRACK_WIDTH = 298;
+const int MAX_VIEW_ROWS = 98;
+const int MIN_TRACK_WIDTH = 20;
+const int MIN_VIEW_ROWS = 10;
+const int DYNAMIC_SIZE = 0;
+
+// Obstacle ring size for a track height: spawns are >= 2 rows apart, and
+// the ring is a power of two (so indices wrap with a mask) and a multiple
+// of 32 (so kernels consume whole mask words)
+constexpr int obstacleCapacityFor(int height) {
+    return height == DYNAMIC_SIZE || height / 2 + 2 > 32 ? 64 : 32;
+}
+static_assert(obstacleCapacityFor(MAX_VIEW_ROWS) >= MAX_VIEW_ROWS / 2 + 2, "obstacle ring size");
+
+template <int W, int H>
+struct TrackGeometry {
+    int width() const { return W; }
+    int height() const { return H; }
+};
+
+template <>
+struct TrackGeometry<DYNAMIC_SIZE, DYNAMIC_SIZE> {
+    int trackWidth = TRACK_WIDTH;     // set before reset()
+    int trackHeight = SCREEN_HEIGHT;
+    int width() const { return trackWidth; }
+    int height() const { return trackHeight; }
+};
+
+// Everything one game needs, in a single flat object with no heap storage,
+// so many independent games can be stepped side by side in one process.
+template <int W, int H>
+struct TrackGame : TrackGeometry<W, H> {
+    // Only the classic size shares the per-level leaderboards
+    static const bool RANKED = W == TRACK_WIDTH && H == SCREEN_HEIGHT;
+    static const uint8_t REPLAY_MODE = 0;
+    static const int OBSTACLE_CAPACITY = obstacleCapacityFor(H);
+
+    // Obstacle ring as structure-of-arrays, live cars oldest first: column
+    // and world row (mod 2^16) per slot. Free slots hold carX = 0, which no
+    // player column matches, so kernels can scan every slot unmasked.
+    int16_t carX[OBSTACLE_CAPACITY];
+    int16_t carRow[OBSTACLE_CAPACITY];
+    int obstacleHead = 0;
+    int obstacleCount = 0;
+    long long scrollRow = 0;          // world row currently shown at screen y = 1
+
+    int playerX = START_PLAYER_X;
+    long long score = 0;
+    bool gameOver = false;
+    int difficultyLevel = 1;          // 1..5
+    Rng rng;                          // spawn decisions; reset() leaves it alone
+    // Spawn rule (varied by --tune): on an empty road a car appears with
+    // probability spawnChance / 10, otherwise once the newest car has moved
+    // more than spawnGap rows down. spawnGap >= 2 keeps the ring big enough.
+    int spawnChance = 3;
+    int spawnGap = 2;
+
+    using TrackGeometry<W, H>::width;
+    using TrackGeometry<W, H>::height;
+
+    void reset(int level);
+    bool movePlayer(int dir);
+    void updateObstacles();
+    void checkCollision();
+    void tick(int move);
+    std::chrono::milliseconds tickDuration() const;
+
+    int slot(int i) const { return (obstacleHead + i) & (OBSTACLE_CAPACITY - 1); }
+    int screenY(int s) const {
+        return (int16_t)(uint16_t)((uint16_t)scrollRow - (uint16_t)carRow[s]) + 1;
+    }
+    int columns() const { return width() + 2; } // including both borders
+    int rows() const { return height(); }
+};
+
+typedef TrackGame<TRACK_WIDTH, SCREEN_HEIGHT> GameState;
+
+// Endurance mode: a track of up to MAX_TRACK_WIDTH x MAX_VIEW_ROWS with a
+// curving road and several lanes of traffic. The world is generated
+// CHUNK_ROWS rows at a time, one chunk ahead of the view, into a fixed pool
+// indexed by chunk number, so each new chunk reuses the slot of one that
+// has scrolled out behind the player and memory never grows.
+const int CHUNK_ROWS = 32;
+// Chunks touched by the view, plus the one generated ahead of it
+const int ENDURANCE_CHUNKS = (MAX_VIEW_ROWS - 1) / CHUNK_ROWS + 1 + 2;
+const int LANE_WIDTH = 4;         // a car fills its whole lane
+const int MAX_LANES = 16;
+const int TRAFFIC_SPACING = 3;    // rows between rows of traffic
+typedef std::bitset<MAX_TRACK_WIDTH + 2> WideRowBits;
+
+struct TrackChunk {
+    long long index = -1;               // holds world rows index * CHUNK_ROWS ...
+    int16_t roadLeft[CHUNK_ROWS];       // first road column (same numbering as playerX)
+    int16_t roadWidth[CHUNK_ROWS];
+    uint8_t carCount[CHUNK_ROWS];       // scored when the row leaves the screen
+    WideRowBits cars[CHUNK_ROWS];
+};
+
+// Same stepping interface as GameState, so the game loop and replays are
+// shared. Like GameState it owns no heap storage.
+struct EnduranceGame {
+    static const bool RANKED = false;   // not entered on the per-level leaderboards
+    static const uint8_t REPLAY_MODE = 1;
+
+    int trackWidth = 78;                // set before reset()
+    int viewRows = 40;
+    TrackChunk chunks[ENDURANCE_CHUNKS];
+    long long nextChunk = 0;            // next chunk index to generate
+    long long scrollRow = 0;            // world row currently shown at screen y = 1
+    // Road generator state, carried across chunk boundaries
+    int lanes = 2;
+    int roadCenter = 0;
+    int roadDrift = 0;
+    int trafficGap = 0;                 // lane left open in the last traffic row
+
+    int playerX = 0;
+    long long score = 0;
+    bool gameOver = false;
+    int difficultyLevel = 1;
+    Rng rng;
+
+    void reset(int level);
+    bool movePlayer(int dir);
+    void updateObstacles();
+    void checkCollision();
+    void tick(int move);
+    std::chrono::milliseconds tickDuration() const;
+    void generateChunk(long long index);
+
+    int columns() const { return trackWidth + 2; }
+    int rows() const { return viewRows; }
+    long long playerRow() const { return scrollRow - viewRows + 1; }
+    const TrackChunk &chunkFor(long long row) const {
+        return chunks[(row / CHUNK_ROWS) % ENDURANCE_CHUNKS];
+    }
+};
+
+// --- Key Codes ---
+// Key presses are resolved to small integers once, when they are decoded
+// (and so when they are bound). Single bytes are their own code; multi-byte
+// sequences (arrows, function keys, WIN_SEQ(n)) are interned into
+// keySequences and numbered from 256. Dispatch is then a table lookup.
+typedef uint16_t KeyCode;
+const KeyCode KEY_NONE = 0xFFFF;
+const int MAX_SEQ_LEN = 16;
+const int MAX_SEQUENCE_KEYS = 64;
+const int KEY_CODE_LIMIT = 256 + MAX_SEQUENCE_KEYS;
+const KeyCode KEY_UP = 256;
+const KeyCode KEY_DOWN = 257;
+const KeyCode KEY_RIGHT = 258;
+const KeyCode KEY_LEFT = 259;
+
+struct KeySequence {
+    char seq[MAX_SEQ_LEN];
+    uint8_t len;
+};
+KeySequence keySequences[MAX_SEQUENCE_KEYS] = {
+    {"\033[A", 3}, {"\033[B", 3}, {"\033[C", 3}, {"\033[D", 3},
+};
+int keySequenceCount = 4;
 
-std::vector<Car> obstacles;
-int playerX = START_PLAYER_X;
-long long score = 0;
-bool gameOver = false;
+// KEY_NONE if the sequence table is full
+KeyCode keyCodeFor(const char *seq, int len) {
+    if (len == 1) return (unsigned char)seq[0];
+    for (int i = 0; i < keySequenceCount; ++i) {
+        if (keySequences[i].len == len && std::memcmp(keySequences[i].seq, seq, len) == 0) {
+            return (KeyCode)(256 + i);
+        }
+    }
+    if (len <= 0 || len > MAX_SEQ_LEN || keySequenceCount == MAX_SEQUENCE_KEYS) return KEY_NONE;
+    KeySequence &entry = keySequences[keySequenceCount];
+    std::memcpy(entry.seq, seq, len);
+    entry.len = (uint8_t)len;
+    return (KeyCode)(256 + keySequenceCount++);
+}
+
+std::string keySequence(KeyCode key) {
+    if (key < 256) return std::string(1, (char)key);
+    if (key < 256 + keySequenceCount) {
+        const KeySequence &entry = keySequences[key - 256];
+        return std::string(entry.seq, entry.len);
+    }
+    return std::string();
+}
+
+// What a key does in game; rebuilt by rebuildKeyActions() when bindings change
+enum KeyAction : uint8_t { ACTION_NONE, ACTION_LEFT, ACTION_RIGHT, ACTION_QUIT, ACTION_TOGGLE_HUD };
+KeyAction keyActions[KEY_CODE_LIMIT];
 
 // --- Game Settings & Persistence ---
-long long highestScore = 0;
-int difficultyLevel = 1; // 1..5
+// Fixed-size binary leaderboard: the top LEADERBOARD_SIZE scores of every
+// level, best first. Its size never changes, so loading and saving cost
+// the same however many games have been played.
+const int LEVEL_COUNT = 5;
+const int LEADERBOARD_SIZE = 10;
+const int PLAYER_NAME_LEN = 16;
+const uint32_t LEADERBOARD_VERSION = 1;
+
+struct ScoreEntry {
+    int64_t score;               // 0 marks an empty slot
+    int64_t timestamp;           // seconds since the epoch
+    char name[PLAYER_NAME_LEN];  // NUL-padded
+};
 
-// Controls (store sequences uniformly across platforms)
-std::string moveLeftKey = "a";
-std::string moveRightKey = "d";
+// On-disk layout, written in host byte order
+struct Leaderboard {
+    char magic[4];               // "TRHS"
+    uint32_t version;
+    uint32_t levels;
+    uint32_t entriesPerLevel;
+    ScoreEntry entries[LEVEL_COUNT][LEADERBOARD_SIZE];
+};
+static_assert(sizeof(ScoreEntry) == 32, "leaderboard entry layout");
+static_assert(sizeof(Leaderboard) == 16 + LEVEL_COUNT * LEADERBOARD_SIZE * 32, "leaderboard layout");
+
+Leaderboard leaderboard;
+
+// Choices made in the menus, applied to each new game
+struct PlayerSettings {
+    int difficultyLevel = 1; // 1..5
+    std::string playerName = "player"; // shown on the leaderboard
+    // Controls (store sequences uniformly across platforms)
+    KeyCode moveLeftKey = 'a';
+    KeyCode moveRightKey = 'd';
+};
+PlayerSettings settings;
+
+// Rendering: a frame is drawn only when frameDirty is set by a tick or a
+// player move. maxFps > 0 additionally caps how often frames may go out.
+bool frameDirty = true;
+int maxFps = 0;
+bool syncRender = false; // --sync-render: no render thread, frames block the game loop
+
+// Seed for the first game in this process (--seed); defaults to the clock.
+// Each further interactive game uses the next seed.
+uint64_t gameSeed = 0;
+bool gameSeedSet = false;
+
+// Replays: --record writes each game to recordFile, --replay plays one back
+std::string recordFile;
+int recordedGames = 0; // this session, so each game gets its own file
+std::string replayFile;
+bool replayFast = false; // --fast: no tick delays during playback
+
+// Headless simulation (--headless): no terminal, random input, timed ticks
+bool headlessMode = false;
+long long headlessTicks = 1000000;
+bool headlessRender = false;  // --render: also draw every tick
+bool requireNoAllocs = false; // --no-alloc: fail if the measured loop allocates
+// Endurance mode (--endurance): large generated tracks
+bool enduranceMode = false;
+// Track size (--track WxH, or --track fit for the terminal size). Without
+// it standard games use the classic 20x20 track and endurance games fit
+// the terminal.
+int customTrackWidth = 78;
+int customTrackRows = 40;
+bool customTrackSize = false;
+bool fitTrack = false;
+// Batch simulation (--batch G): G independent games stepped in parallel
+int batchGames = 0;
+int batchThreads = 0; // 0 = one per hardware thread (also for --tune)
+// Difficulty tuning (--tune): survival histograms over levels, bots and
+// spawn parameters
+bool tuneMode = false;
+// Micro-benchmarks (--bench): JSON results on stdout
+bool benchMode = false;
+std::string benchFilter;  // --bench-filter: only names containing this
+int tuneGames = 10000; // games per combination
+std::vector<int> tuneSpawnChances = {2, 3, 5};
+std::vector<int> tuneSpawnGaps = {2, 3, 4};
 
 #ifdef _WIN32
     // Windows console saved state
     static DWORD originalConsoleMode = 0;
     static HANDLE hStdin = nullptr;
     static HANDLE hStdout = nullptr;
+    // Screen buffer frames are drawn into while the console backend is active
+    static HANDLE hGameOut = nullptr;
+    // --double-buffer: draw into a hidden screen buffer and flip
+    bool consoleDoubleBuffer = false;
 #else
     // Unix saved state
     struct termios originalTermios;
 #endif
 
+// --- Allocation accounting ---
+// Every operator new is counted so the headless benchmark can report heap
+// traffic in the simulation loop. The replacements are kept out of line:
+// once inlined, GCC pairs the malloc/free inside them with new/delete at
+// call sites and warns (-Wmismatched-new-delete). The library build leaves
+// them out, as a shared object would export them to the whole host process.
+#if defined(_MSC_VER)
+    #define CARGAME_NOINLINE __declspec(noinline)
+#else
+    #define CARGAME_NOINLINE __attribute__((noinline))
+#endif
+
+static std::atomic<unsigned long long> allocationCount{0};
+
+#ifndef CARGAME_LIBRARY
+CARGAME_NOINLINE void *operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (void *p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+CARGAME_NOINLINE void operator delete(void *p) noexcept { std::free(p); }
+CARGAME_NOINLINE void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+#endif // CARGAME_LIBRARY
+
+// --- Frame Buffers ---
+// backBuffer is composed each frame, frontBuffer mirrors what the terminal
+// currently shows; only cells that differ between the two are sent. Both are
+// sized by setFrameSize() when a game starts and reused for every frame.
+//
+// When the terminal is smaller than the frame only a viewport of it is sent:
+// the bottom track rows (where the player is) above the status and HUD rows,
+// scrolled sideways to keep the player in view. frontBuffer is viewport-sized.
+int frameCols = FRAME_COLS;
+int frameRows = SCREEN_HEIGHT + 2;
+int frameTrackCols = TRACK_WIDTH + 2;
+std::vector<char> frontBuffer;
+std::vector<char> backBuffer;
+// What never changes during a game: borders, empty road, blank status and
+// HUD rows. Copied into backBuffer at the start of every frame.
+std::vector<char> frameTemplate;
+std::string frameOut;
+bool discardFrames = false; // compose and diff frames but send nothing (benchmarks)
+
+// Terminal size from the last query, 0 when unknown (output is not a tty)
+int terminalCols = 0;
+int terminalRows = 0;
+int viewportCols = FRAME_COLS;
+int viewportRows = SCREEN_HEIGHT + 2;
+int viewportColOffset = 0;
+
+void fitViewport(int termCols, int termRows) {
+    viewportCols = termCols > 0 ? std::min(frameCols, termCols) : frameCols;
+    // Always keep one track row above the status and HUD rows
+    viewportRows = termRows > 0 ? std::min(frameRows, std::max(termRows, 3)) : frameRows;
+    viewportColOffset = 0;
+    frontBuffer.assign((size_t)viewportCols * viewportRows, ' ');
+}
+
+void setFrameSize(int trackCols, int trackRows) {
+    frameCols = std::max(trackCols, FRAME_COLS);
+    frameRows = trackRows + 2;
+    frameTrackCols = trackCols;
+    backBuffer.assign((size_t)frameCols * frameRows, ' ');
+    frameTemplate.assign((size_t)frameCols * frameRows, ' ');
+    for (int y = 0; y < trackRows; ++y) {
+        char *row = frameTemplate.data() + (size_t)y * frameCols;
+        row[0] = BORDER_CHAR;
+        std::memset(row + 1, ROAD_CHAR, (size_t)(trackCols - 2));
+        row[trackCols - 1] = BORDER_CHAR;
+    }
+    frameOut.reserve((size_t)frameCols * frameRows * 2);
+    fitViewport(terminalCols, terminalRows);
+}
+
+// --- Instrumentation ---
+// Opt-in (--profile) phase timers for the interactive loop. Recent samples
+// feed the in-game HUD (toggled with 'p'); with --profile-out every sample
+// is also kept and dumped on exit as CSV, or Chrome trace JSON for *.json.
+enum ProfilePhase { PHASE_INPUT, PHASE_UPDATE, PHASE_COLLISION, PHASE_DRAW, PHASE_FLUSH, PHASE_COUNT };
+const char *const PHASE_NAMES[PHASE_COUNT] = {"input", "update", "collision", "draw", "flush"};
+const char *const PHASE_LABELS[PHASE_COUNT] = {"in", "upd", "col", "drw", "out"};
+
+const int PROFILE_WINDOW = 256;           // samples per phase behind p50/p99
+const size_t PROFILE_TRACE_LIMIT = 1 << 20; // trace stops growing past this
+
+inline long long nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct TraceSample {
+    uint8_t phase;
+    long long startNs;
+    long long durationNs;
+};
+
+struct Profiler {
+    bool enabled = false;
+    bool hudVisible = true;
+    std::string outFile;
+    long long originNs = 0;
+
+    uint32_t recent[PHASE_COUNT][PROFILE_WINDOW] = {};
+    int recentCount[PHASE_COUNT] = {};
+    int recentNext[PHASE_COUNT] = {};
+    std::vector<TraceSample> trace;
+
+    size_t lastFrameBytes = 0;
+    int lastFrameWrites = 0;   // write syscalls the last frame took
+    long long framesSinceHud = 0;
+    long long hudUpdatedNs = 0;
+    char hud[FRAME_COLS + 1] = ""; // the HUD never needs more than the minimum width
+
+    void start() {
+        enabled = true;
+        originNs = nowNs();
+        hudUpdatedNs = originNs;
+        if (!outFile.empty()) trace.reserve(PROFILE_TRACE_LIMIT);
+    }
+
+    void record(ProfilePhase phase, long long startNs, long long endNs) {
+        long long duration = endNs - startNs;
+        recent[phase][recentNext[phase]] = (uint32_t)std::min(duration, (long long)UINT32_MAX);
+        recentNext[phase] = (recentNext[phase] + 1) % PROFILE_WINDOW;
+        if (recentCount[phase] < PROFILE_WINDOW) recentCount[phase]++;
+        if (!outFile.empty() && trace.size() < PROFILE_TRACE_LIMIT) {
+            trace.push_back({(uint8_t)phase, startNs - originNs, duration});
+        }
+    }
+
+    void frameSent(size_t bytes, int writes) {
+        lastFrameBytes = bytes;
+        lastFrameWrites = writes;
+        framesSinceHud++;
+    }
+
+    // Percentile of the recent window, in microseconds
+    double percentileUs(ProfilePhase phase, double q) const {
+        int n = recentCount[phase];
+        if (n == 0) return 0.0;
+        uint32_t sorted[PROFILE_WINDOW];
+        std::copy(recent[phase], recent[phase] + n, sorted);
+        int k = std::min(n - 1, (int)(q * n));
+        std::nth_element(sorted, sorted + k, sorted + n);
+        return sorted[k] / 1000.0;
+    }
+
+    // HUD text, recomputed at most twice a second
+    const char *hudLine() {
+        long long now = nowNs();
+        if (hud[0] && now - hudUpdatedNs < 500000000LL) return hud;
+        double fps = now > hudUpdatedNs ? framesSinceHud * 1e9 / (now - hudUpdatedNs) : 0.0;
+        framesSinceHud = 0;
+        hudUpdatedNs = now;
+
+        char *buf = hud;
+        const size_t bufSize = sizeof(hud);
+        int len = std::snprintf(buf, bufSize, "us p50/p99");
+        for (int p = 0; p < PHASE_COUNT && len < (int)bufSize; ++p) {
+            len += std::snprintf(buf + len, bufSize - len, " %s %.1f/%.1f", PHASE_LABELS[p],
+                                 percentileUs((ProfilePhase)p, 0.5), percentileUs((ProfilePhase)p, 0.99));
+        }
+        if (len < (int)bufSize) {
+            std::snprintf(buf + len, bufSize - len, " | %zuB/%dw %.0ffps", lastFrameBytes,
+                          lastFrameWrites, fps);
+        }
+        return hud;
+    }
+
+    bool dump() const {
+        std::ofstream file(outFile, std::ios::trunc);
+        if (!file.is_open()) return false;
+        bool json = outFile.size() >= 5 && outFile.compare(outFile.size() - 5, 5, ".json") == 0;
+        if (json) {
+            file << "{\"traceEvents\":[";
+            for (size_t i = 0; i < trace.size(); ++i) {
+                const TraceSample &t = trace[i];
+                file << (i ? "," : "") << "\n{\"name\":\"" << PHASE_NAMES[t.phase]
+                     << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << t.startNs / 1000.0
+                     << ",\"dur\":" << t.durationNs / 1000.0 << "}";
+            }
+            file << "\n]}\n";
+        } else {
+            file << "phase,start_us,duration_us\n";
+            for (const auto &t : trace) {
+                file << PHASE_NAMES[t.phase] << "," << t.startNs / 1000.0 << ","
+                     << t.durationNs / 1000.0 << "\n";
+            }
+        }
+        return (bool)file;
+    }
+};
+Profiler profiler;
+
+// Times the enclosing scope into the profiler; a single branch when disabled
+struct ScopedTimer {
+    ProfilePhase phase;
+    long long startNs;
+    explicit ScopedTimer(ProfilePhase p) : phase(p), startNs(profiler.enabled ? nowNs() : 0) {}
+    ~ScopedTimer() {
+        if (profiler.enabled) profiler.record(phase, startNs, nowNs());
+    }
+};
+
 // --- Terminal utilities (cross-platform) ---
 
 void gotoxy(int y, int x) {
@@ -101,6 +663,86 @@ void showCursor() {
 #endif
 }
 
+#ifndef _WIN32
+volatile sig_atomic_t terminalResized = 0;
+void onTerminalResize(int) { terminalResized = 1; }
+
+// What a signal or exit() that cuts the game short must still undo: the
+// termios settings while setupTerminal() is in effect, and stdout's file
+// status flags while the output sink keeps it non-blocking (-1 otherwise).
+volatile sig_atomic_t terminalRaw = 0;
+volatile sig_atomic_t savedStdoutFlags = -1;
+
+// Async-signal-safe; does nothing once restoreTerminal() has run
+void restoreTerminalState() {
+    if (savedStdoutFlags >= 0) fcntl(STDOUT_FILENO, F_SETFL, (int)savedStdoutFlags);
+    savedStdoutFlags = -1;
+    if (!terminalRaw) return;
+    terminalRaw = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &originalTermios);
+    ssize_t ignored = write(STDOUT_FILENO, "\033[?25h", 6);
+    (void)ignored;
+}
+
+void restoreTerminalAtExit() { restoreTerminalState(); }
+
+// Hand the shell back a sane terminal, then die of the signal as usual
+void onFatalSignal(int sig) {
+    restoreTerminalState();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void installTerminalRestore() {
+    static bool installed = false;
+    if (installed) return;
+    installed = true;
+    std::atexit(restoreTerminalAtExit);
+    for (int sig : {SIGINT, SIGTERM, SIGHUP}) {
+        struct sigaction sa, old;
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = onFatalSignal;
+        sigemptyset(&sa.sa_mask);
+        // Leave signals the parent ignores (nohup) ignored
+        if (sigaction(sig, nullptr, &old) == 0 && old.sa_handler == SIG_IGN) continue;
+        sigaction(sig, &sa, nullptr);
+    }
+}
+#endif
+
+// Current size of the visible terminal window; false if it cannot be read
+bool queryTerminalSize(int &cols, int &rows) {
+#ifdef _WIN32
+    if (!hStdout) hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    if (!GetConsoleScreenBufferInfo(hGameOut ? hGameOut : hStdout, &info)) return false;
+    cols = info.srWindow.Right - info.srWindow.Left + 1;
+    rows = info.srWindow.Bottom - info.srWindow.Top + 1;
+#else
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0 || ws.ws_row == 0) return false;
+    cols = ws.ws_col;
+    rows = ws.ws_row;
+#endif
+    return true;
+}
+
+// Re-read the terminal size if it may have changed; true if it did. On
+// POSIX this is only after a SIGWINCH, which also cuts waitForInput()
+// short. The Windows console has no such signal without switching input
+// to ReadConsoleInput, so there the size is simply re-read each call.
+bool pollTerminalResize() {
+#ifndef _WIN32
+    if (!terminalResized) return false;
+    terminalResized = 0;
+#endif
+    int cols, rows;
+    if (!queryTerminalSize(cols, rows) || (cols == terminalCols && rows == terminalRows)) return false;
+    terminalCols = cols;
+    terminalRows = rows;
+    return true;
+}
+
 void setupTerminal() {
 #ifdef _WIN32
     // Get handles
@@ -128,8 +770,21 @@ void setupTerminal() {
     newt.c_lflag &= ~(ICANON | ECHO); // non-canonical, no-echo
     newt.c_cc[VMIN] = 0;
     newt.c_cc[VTIME] = 0;
+    installTerminalRestore();
     tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+    terminalRaw = 1;
+
+    // SA_RESTART so a resize never fails a blocking read or write; select()
+    // is not restarted whatever the flag says, so the wait for input still
+    // wakes on one
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onTerminalResize;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGWINCH, &sa, nullptr);
 #endif
+    queryTerminalSize(terminalCols, terminalRows);
 }
 
 void restoreTerminal() {
@@ -139,343 +794,3177 @@ void restoreTerminal() {
     }
     showCursor();
 #else
+    terminalRaw = 0;
     tcsetattr(STDIN_FILENO, TCSANOW, &originalTermios);
     std::cout << "\033[?25h";
 #endif
     std::cout.flush();
 }
 
+// Write raw bytes to the terminal, bypassing std::cout; blocks until all
+// of it is written. Returns the number of write calls it took.
+int writeOut(const char *data, size_t len) {
+#ifdef _WIN32
+    if (!hStdout) hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD written = 0;
+    WriteConsoleA(hStdout, data, (DWORD)len, &written, nullptr);
+    return 1;
+#else
+    int writes = 0;
+    while (len > 0) {
+        ssize_t w = write(STDOUT_FILENO, data, len);
+        writes++;
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        data += w;
+        len -= (size_t)w;
+    }
+    return writes;
+#endif
+}
+
+// --- Output Sink ---
+// The render thread's path to the terminal. While it runs, a tty stdout is
+// switched to non-blocking mode: when the terminal stops taking output (a
+// stalled SSH session) the unsent tail of a frame is kept in a backlog
+// reserved up front, and later goes out together with the next frame in one
+// writev(). Anywhere else (not a tty, Windows) a send blocks like writeOut().
+class OutputSink {
+public:
+    size_t lastBytes = 0; // written by the last send()
+    int lastWrites = 0;   // syscalls the last send() made
+
+    void begin(size_t capacity) {
+        backlog.reserve(capacity);
+        backlog.clear();
+#ifndef _WIN32
+        // Published before the switch so a signal in between still undoes it
+        int flags = isatty(STDOUT_FILENO) ? fcntl(STDOUT_FILENO, F_GETFL) : -1;
+        savedStdoutFlags = flags;
+        if (flags >= 0 && fcntl(STDOUT_FILENO, F_SETFL, flags | O_NONBLOCK) != 0) savedStdoutFlags = -1;
+#endif
+    }
+
+    // Restore blocking writes and send whatever is still in the backlog
+    void end() {
+#ifndef _WIN32
+        if (savedStdoutFlags >= 0) fcntl(STDOUT_FILENO, F_SETFL, (int)savedStdoutFlags);
+        savedStdoutFlags = -1;
+#endif
+        if (!backlog.empty()) writeOut(backlog.data(), backlog.size());
+        backlog.clear();
+    }
+
+    bool backlogged() const { return !backlog.empty(); }
 
-std::string getInputSequence() {
+    // Write the backlog followed by data (len may be 0). Whatever the
+    // terminal would not take stays in the backlog.
+    void send(const char *data, size_t len) {
+        lastBytes = 0;
+        lastWrites = 0;
 #ifdef _WIN32
-    if (!_kbhit()) return std::string();
-    int ch = _getch();
-    if (ch == 0 || ch == 224) {
-        // special key: read next code
-        int code = _getch();
-        switch (code) {
-            case 72: return "\033[A"; // Up
-            case 80: return "\033[B"; // Down
-            case 77: return "\033[C"; // Right
-            case 75: return "\033[D"; // Left
-            default:
-                // Return a descriptive sequence with code
-                {
-                    std::ostringstream oss;
-                    oss << "WIN_SEQ(" << code << ")";
-                    return oss.str();
-                }
+        if (len) lastWrites = writeOut(data, len);
+        lastBytes = len;
+#else
+        size_t sent = 0; // of the backlog
+        while (sent < backlog.size() || len > 0) {
+            struct iovec iov[2];
+            int count = 0;
+            if (sent < backlog.size()) iov[count++] = {backlog.data() + sent, backlog.size() - sent};
+            if (len > 0) iov[count++] = {const_cast<char *>(data), len};
+            ssize_t w = writev(STDOUT_FILENO, iov, count);
+            lastWrites++;
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                backlog.clear(); // the terminal is gone; nothing left to show it
+                return;
+            }
+            lastBytes += (size_t)w;
+            size_t fromBacklog = std::min((size_t)w, backlog.size() - sent);
+            sent += fromBacklog;
+            data += (size_t)w - fromBacklog;
+            len -= (size_t)w - fromBacklog;
         }
-    } else {
-        // Normal character
-        char c = static_cast<char>(ch);
-        return std::string(1, c);
+        // writev() fills its buffers in order, so anything of data that is
+        // left means the backlog went out whole
+        backlog.erase(backlog.begin(), backlog.begin() + (std::ptrdiff_t)sent);
+        backlog.insert(backlog.end(), data, data + len);
+#endif
     }
+
+    // Wait at most timeoutMs for the terminal to take more output
+    void waitWritable(int timeoutMs) {
+#ifndef _WIN32
+        struct pollfd pfd = {STDOUT_FILENO, POLLOUT, 0};
+        poll(&pfd, 1, timeoutMs);
 #else
-    std::string res;
-    char c = 0;
+        (void)timeoutMs;
+#endif
+    }
 
-    fd_set rdset;
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = 0;
+private:
+    std::vector<char> backlog;
+};
+OutputSink outputSink;
 
+// Block until input is pending or the timeout expires; a negative timeout
+// waits indefinitely. Returns early on signals, callers re-check their state.
+void waitForInput(std::chrono::microseconds timeout) {
+#ifdef _WIN32
+    if (!hStdin) hStdin = GetStdHandle(STD_INPUT_HANDLE);
+    DWORD ms = INFINITE;
+    if (timeout.count() >= 0) ms = (DWORD)((timeout.count() + 999) / 1000);
+    WaitForSingleObject(hStdin, ms);
+#else
+    fd_set rdset;
     FD_ZERO(&rdset);
     FD_SET(STDIN_FILENO, &rdset);
+    struct timeval tv;
+    tv.tv_sec = (time_t)(timeout.count() / 1000000);
+    tv.tv_usec = (suseconds_t)(timeout.count() % 1000000);
+    select(STDIN_FILENO + 1, &rdset, NULL, NULL, timeout.count() < 0 ? NULL : &tv);
+#endif
+}
 
-    if (select(STDIN_FILENO + 1, &rdset, NULL, NULL, &tv) > 0) {
-        ssize_t r = read(STDIN_FILENO, &c, 1);
-        if (r > 0) {
-            res.push_back(c);
-            if (c == '\033') { // potential escape sequence
-                const int maxWaitMs = 100;
-                int waited = 0;
-                while (waited < maxWaitMs) {
-                    int bytesAvailable = 0;
-                    ioctl(STDIN_FILENO, FIONREAD, &bytesAvailable);
-                    if (bytesAvailable > 0) {
-                        char buf[10];
-                        ssize_t r2 = read(STDIN_FILENO, buf, std::min(bytesAvailable, 9));
-                        if (r2 > 0) res.append(buf, buf + r2);
-                        break;
-                    }
-                    std::this_thread::sleep_for(std::chrono::milliseconds(8));
-                    waited += 8;
-                }
+// --- Input Decoding ---
+// Raw bytes are decoded without blocking by a small state machine and
+// queued as key events. A lone ESC is only reported once ESC_TIMEOUT
+// passes with no follow-up byte; callers that wait for input should wake
+// by escapeDeadline() while a sequence is pending.
+const int INPUT_QUEUE_SIZE = 32;
+const std::chrono::milliseconds ESC_TIMEOUT(50);
+
+struct InputEvent {
+    KeyCode key;
+    uint8_t repeat; // identical presses merged into this event
+};
+
+// Bounded ring of key events. A press identical to the newest queued event
+// bumps its repeat count instead of taking a slot, so key auto-repeat cannot
+// fill the queue; when it is full anyway, new keys are dropped.
+struct InputQueue {
+    InputEvent events[INPUT_QUEUE_SIZE];
+    int head = 0;
+    int count = 0;
+
+    void clear() { head = 0; count = 0; }
+
+    void push(KeyCode key) {
+        if (key == KEY_NONE) return;
+        if (count > 0) {
+            InputEvent &last = events[(head + count - 1) % INPUT_QUEUE_SIZE];
+            if (last.key == key && last.repeat < 255) {
+                last.repeat++;
+                return;
             }
         }
+        if (count == INPUT_QUEUE_SIZE) return;
+        events[(head + count) % INPUT_QUEUE_SIZE] = {key, 1};
+        count++;
     }
-    return res;
-#endif
-}
 
-std::string keyToDisplay(const std::string &k) {
-    if (k.empty()) return "NONE";
-    if (k == "\033[A") return "UP_ARROW";
-    if (k == "\033[B") return "DOWN_ARROW";
-    if (k == "\033[C") return "RIGHT_ARROW";
-    if (k == "\033[D") return "LEFT_ARROW";
-    if (k == "\n" || k == "\r") return "ENTER";
-    if (k == " ") return "SPACE";
-    if (k == "\t") return "TAB";
-    if (k.size() == 1 && isprint(static_cast<unsigned char>(k[0]))) {
-        return std::string(1, k[0]);
-    }
-    std::ostringstream oss;
-    oss << "SEQ(";
-    for (unsigned char ch : k) {
-        oss << "0x" << std::hex << std::uppercase << (int)ch << " ";
+    // Pop the oldest event together with its repeat count
+    bool pop(InputEvent &out) {
+        if (count == 0) return false;
+        out = events[head];
+        head = (head + 1) % INPUT_QUEUE_SIZE;
+        count--;
+        return true;
     }
-    oss << ")";
-    return oss.str();
-}
 
-// --- High Score Persistence ---
-void loadHighestScore() {
-    std::ifstream file(HIGHSCORE_FILE);
-    if (file.is_open()) {
-        file >> highestScore;
-        file.close();
-    }
-}
-void saveHighestScore() {
-    if (score > highestScore) {
-        highestScore = score;
-        std::ofstream file(HIGHSCORE_FILE);
-        if (file.is_open()) {
-            file << highestScore;
-            file.close();
+    // Pop a single press of the oldest event
+    bool popOne(InputEvent &out) {
+        if (count == 0) return false;
+        InputEvent &e = events[head];
+        out = e;
+        out.repeat = 1;
+        if (--e.repeat == 0) {
+            head = (head + 1) % INPUT_QUEUE_SIZE;
+            count--;
         }
+        return true;
     }
-}
+};
 
-// --- Game Logic ---
-void updateObstacles() {
-    for (auto &obs : obstacles) obs.y++;
-    if (!obstacles.empty() && obstacles.front().y > SCREEN_HEIGHT) {
-        obstacles.erase(obstacles.begin());
-        score += 10;
-    }
-    bool shouldSpawn = (rand() % 10 < 3 && obstacles.empty()) ||
-                       (!obstacles.empty() && obstacles.back().y > 2);
-    if (shouldSpawn) {
-        int newX = (rand() % TRACK_WIDTH) + 2;
-        obstacles.push_back({newX, 1});
+struct InputDecoder {
+    enum State { GROUND, ESCAPE, SEQUENCE } state = GROUND;
+    char buf[MAX_SEQ_LEN];
+    int len = 0;
+    std::chrono::steady_clock::time_point escapeTime;
+
+    bool pending() const { return state != GROUND; }
+    std::chrono::steady_clock::time_point escapeDeadline() const { return escapeTime + ESC_TIMEOUT; }
+
+    void emit(InputQueue &queue) {
+        // Application cursor mode sends ESC O A..D; report the usual ESC [ form
+        if (len == 3 && buf[1] == 'O' && buf[2] >= 'A' && buf[2] <= 'D') buf[1] = '[';
+        queue.push(keyCodeFor(buf, len));
+        state = GROUND;
+        len = 0;
     }
-}
-void checkCollision() {
-    for (const auto &obs : obstacles) {
-        if (obs.y == SCREEN_HEIGHT && obs.x == playerX) {
-            gameOver = true;
-            break;
+
+    void feed(char c, InputQueue &queue) {
+        switch (state) {
+            case GROUND:
+                if (c == '\033') {
+                    buf[0] = c;
+                    len = 1;
+                    state = ESCAPE;
+                    escapeTime = std::chrono::steady_clock::now();
+                } else {
+                    queue.push((unsigned char)c);
+                }
+                break;
+            case ESCAPE:
+                buf[len++] = c;
+                if (c == '[' || c == 'O') state = SEQUENCE; // CSI / SS3
+                else emit(queue);                           // ESC + key (Alt)
+                break;
+            case SEQUENCE:
+                buf[len++] = c;
+                // Parameter and intermediate bytes continue, a final byte ends it
+                if ((c >= 0x40 && c <= 0x7E) || len == MAX_SEQ_LEN) emit(queue);
+                break;
         }
     }
-}
 
-// --- Rendering ---
-void draw() {
-    gotoxy(1,1);
-    for (int y = 1; y <= SCREEN_HEIGHT; ++y) {
-        for (int x = 1; x <= TRACK_WIDTH + 2; ++x) {
-            if (x == 1 || x == TRACK_WIDTH + 2) {
-                std::cout << BORDER_CHAR;
-            } else if (y == SCREEN_HEIGHT && x == playerX) {
-                std::cout << PLAYER_CHAR;
-            } else {
-                bool isObstacle = false;
-                for (const auto &obs : obstacles) {
-                    if (obs.y == y && obs.x == x) {
-                        std::cout << OBSTACLE_CHAR;
-                        isObstacle = true;
-                        break;
-                    }
+    // Flush a sequence whose remaining bytes never arrived
+    void expire(std::chrono::steady_clock::time_point now, InputQueue &queue) {
+        if (pending() && now >= escapeDeadline()) emit(queue);
+    }
+};
+
+InputQueue inputQueue;
+InputDecoder inputDecoder;
+
+// Move every byte the terminal has ready into inputQueue; never blocks
+void pollInput() {
+#ifdef _WIN32
+    while (_kbhit()) {
+        int ch = _getch();
+        if (ch == 0 || ch == 224) {
+            // special key: the second code is already buffered
+            int code = _getch();
+            switch (code) {
+                case 72: inputQueue.push(KEY_UP); break;
+                case 80: inputQueue.push(KEY_DOWN); break;
+                case 77: inputQueue.push(KEY_RIGHT); break;
+                case 75: inputQueue.push(KEY_LEFT); break;
+                default: {
+                    // Descriptive sequence with code
+                    char seq[MAX_SEQ_LEN];
+                    int n = std::snprintf(seq, sizeof(seq), "WIN_SEQ(%d)", code);
+                    inputQueue.push(keyCodeFor(seq, std::min(n, MAX_SEQ_LEN - 1)));
                 }
-                if (!isObstacle) std::cout << ROAD_CHAR;
             }
+        } else {
+            inputDecoder.feed(static_cast<char>(ch), inputQueue);
         }
-        std::cout << "\n";
     }
-    gotoxy(SCREEN_HEIGHT + 1, 1);
-    std::cout << "Score: " << score << " | Level: " << difficultyLevel
-              << " | Controls: Left=" << keyToDisplay(moveLeftKey)
-              << " Right=" << keyToDisplay(moveRightKey) << "    " << std::flush;
+#else
+    // VMIN = 0, VTIME = 0: read returns 0 straight away once drained
+    char buf[64];
+    for (;;) {
+        ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        for (ssize_t i = 0; i < n; ++i) inputDecoder.feed(buf[i], inputQueue);
+    }
+#endif
+    inputDecoder.expire(std::chrono::steady_clock::now(), inputQueue);
 }
 
-// --- Menus ---
-void showControlsMenu() {
-    std::string newKey;
-    std::cout << CLEAR_SCREEN;
-    gotoxy(2,1);
-    std::cout << "--- CONTROL CUSTOMIZATION ---\n\n";
-    std::cout << "Current Left Key : " << keyToDisplay(moveLeftKey) << "\n";
-    std::cout << "Current Right Key: " << keyToDisplay(moveRightKey) << "\n\n";
-    std::cout << "Press any key now to set NEW Left control (arrow keys work)." << std::flush;
+// One key press, or KEY_NONE if none is pending
+KeyCode getInputKey() {
+    pollInput();
+    InputEvent e;
+    if (!inputQueue.popOne(e)) return KEY_NONE;
+    return e.key;
+}
+
+// Bound movement keys win over the fixed keys, as they always have
+void rebuildKeyActions() {
+    std::fill(keyActions, keyActions + KEY_CODE_LIMIT, ACTION_NONE);
+    keyActions['q'] = keyActions['Q'] = keyActions['\x03'] = ACTION_QUIT;
+    keyActions['p'] = keyActions['P'] = ACTION_TOGGLE_HUD;
+    if (settings.moveRightKey < KEY_CODE_LIMIT) keyActions[settings.moveRightKey] = ACTION_RIGHT;
+    if (settings.moveLeftKey < KEY_CODE_LIMIT) keyActions[settings.moveLeftKey] = ACTION_LEFT;
+}
 
-    newKey.clear();
-    while (newKey.empty()) {
-        newKey = getInputSequence();
-        std::this_thread::sleep_for(std::chrono::milliseconds(25));
+// Display name of a key, written into out (at least KEY_NAME_LEN bytes).
+// Builds no strings, so the status bar can use it every frame.
+const size_t KEY_NAME_LEN = 8 + 5 * MAX_SEQ_LEN;
+const char *formatKeyName(KeyCode key, char *out) {
+    const char *seq;
+    int len;
+    char single;
+    if (key < 256) {
+        single = (char)key;
+        seq = &single;
+        len = 1;
+    } else if (key != KEY_NONE && key < 256 + keySequenceCount) {
+        seq = keySequences[key - 256].seq;
+        len = keySequences[key - 256].len;
+    } else {
+        return "NONE";
     }
-    moveLeftKey = newKey;
+    if (key == KEY_UP) return "UP_ARROW";
+    if (key == KEY_DOWN) return "DOWN_ARROW";
+    if (key == KEY_RIGHT) return "RIGHT_ARROW";
+    if (key == KEY_LEFT) return "LEFT_ARROW";
+    if (key == '\n' || key == '\r') return "ENTER";
+    if (key == ' ') return "SPACE";
+    if (key == '\t') return "TAB";
+    if (len == 1 && isprint(static_cast<unsigned char>(seq[0]))) {
+        out[0] = seq[0];
+        out[1] = '\0';
+        return out;
+    }
+    int n = std::snprintf(out, KEY_NAME_LEN, "SEQ(");
+    for (int i = 0; i < len; ++i) {
+        n += std::snprintf(out + n, KEY_NAME_LEN - n, "0x%X ", (unsigned char)seq[i]);
+    }
+    std::snprintf(out + n, KEY_NAME_LEN - n, ")");
+    return out;
+}
 
-    std::cout << "\n\nLeft key assigned to: " << keyToDisplay(moveLeftKey)
-              << "\nNow press any key to set NEW Right control (arrow keys work)." << std::flush;
+std::string keyToDisplay(KeyCode key) {
+    char buf[KEY_NAME_LEN];
+    return formatKeyName(key, buf);
+}
 
-    newKey.clear();
-    while (newKey.empty()) {
-        newKey = getInputSequence();
-        std::this_thread::sleep_for(std::chrono::milliseconds(25));
+// --- Background I/O ---
+// Score, replay and profile writes run on one worker thread so the game
+// thread never waits on the disk. Jobs travel through a lock-free
+// single-producer/single-consumer ring: the game thread only ever writes
+// tail, the worker only ever writes head. The mutex just parks the worker
+// while the ring is empty, and the game thread in the rare case it is full.
+// Before start() (and in headless modes) jobs run inline.
+class IoWorker {
+public:
+    void start() {
+        if (running) return;
+        running = true;
+        thread = std::thread([this] { run(); });
     }
-    moveRightKey = newKey;
 
-    std::cout << "\n\nRight key assigned to: " << keyToDisplay(moveRightKey) << "\n\n";
-    std::cout << "Controls Updated! Left: '" << keyToDisplay(moveLeftKey)
-              << "'  Right: '" << keyToDisplay(moveRightKey) << "'\n\n";
-    std::cout << "Press ENTER to return to the menu..." << std::flush;
+    void post(std::function<void()> job) {
+        if (!running) {
+            job(); // no worker, so nothing else is writing files
+            return;
+        }
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == CAPACITY) {
+            // The disk is far behind. Wait for a slot rather than run the job
+            // here, where it could race the worker on the same file or land
+            // before jobs queued ahead of it.
+            std::unique_lock<std::mutex> lock(wakeLock);
+            space.wait(lock, [&] { return t - head.load(std::memory_order_acquire) < CAPACITY; });
+        }
+        slots[t % CAPACITY] = std::move(job);
+        tail.store(t + 1, std::memory_order_release);
+        { std::lock_guard<std::mutex> guard(wakeLock); }
+        wake.notify_one();
+    }
 
-    // Wait for ENTER in canonical mode
-    restoreTerminal();
-    std::string tmp;
-    std::getline(std::cin, tmp);
-    setupTerminal();
-}
+    // Stop the worker once the ring is drained, waiting at most timeout.
+    // Returns false if jobs were still running when the wait gave up; the
+    // worker is then still live and using this object and other globals,
+    // so the caller must leave with std::_Exit(), which runs no static
+    // destructors under it.
+    bool shutdown(std::chrono::milliseconds timeout) {
+        if (!running) return true;
+        running = false;
+        {
+            std::lock_guard<std::mutex> guard(wakeLock);
+            stopping = true;
+        }
+        wake.notify_one();
+        std::unique_lock<std::mutex> lock(wakeLock);
+        bool drained = finishedCv.wait_for(lock, timeout, [this] { return finished; });
+        lock.unlock();
+        if (drained) thread.join();
+        return drained;
+    }
 
-void showLevelSelect() {
-    int inputLevel = difficultyLevel;
-    std::cout << CLEAR_SCREEN;
-    gotoxy(SCREEN_HEIGHT/2 - 2, 1);
-    std::cout << "--- SELECT DIFFICULTY ---";
-    gotoxy(SCREEN_HEIGHT/2, 1);
-    std::cout << "Levels: 1 (Easy) to 5 (Hardest). Current: " << difficultyLevel;
-    gotoxy(SCREEN_HEIGHT/2 + 1, 1);
-    std::cout << "Enter new level (1-5) and press ENTER: ";
-    restoreTerminal();
-    if (!(std::cin >> inputLevel)) {
-        inputLevel = difficultyLevel;
-        std::cin.clear();
-    }
-    std::cin.ignore(1000, '\n');
-    if (inputLevel >= 1 && inputLevel <= 5) difficultyLevel = inputLevel;
-    std::cout << "Level set to " << difficultyLevel << ". Press ENTER to return to menu.";
-    std::cin.get();
-    setupTerminal();
-}
+private:
+    static const size_t CAPACITY = 64;
+    std::function<void()> slots[CAPACITY];
+    std::atomic<size_t> head{0}; // next slot to run, owned by the worker
+    std::atomic<size_t> tail{0}; // next free slot, owned by the game thread
+    bool running = false;        // game thread only
 
-int showMenu() {
-    int choice = 0;
-    while (true) {
-        std::cout << CLEAR_SCREEN;
-        gotoxy(2,1);
-        std::cout << "--- TERMINAL RACER MENU ---";
-        gotoxy(4,1);
-        std::cout << "1. New Game (Level: " << difficultyLevel << ")";
-        gotoxy(5,1);
-        std::cout << "2. Select Level (1-5)";
-        gotoxy(6,1);
-        std::cout << "3. Controls (Left: '" << keyToDisplay(moveLeftKey) << "', Right: '" << keyToDisplay(moveRightKey) << "')";
-        gotoxy(7,1);
-        std::cout << "4. Highest Score: " << highestScore;
-        gotoxy(8,1);
-        std::cout << "5. Exit";
-        gotoxy(10,1);
-        std::cout << "Enter choice (1-5) and press ENTER: ";
-        restoreTerminal();
-        if (!(std::cin >> choice)) { choice = 0; std::cin.clear(); }
-        std::cin.ignore(1000,'\n');
-        setupTerminal();
+    std::mutex wakeLock;
+    std::condition_variable wake;
+    std::condition_variable space;  // a slot was freed
+    std::condition_variable finishedCv;
+    bool stopping = false;       // guarded by wakeLock
+    bool finished = false;       // guarded by wakeLock
+    std::thread thread;
 
-        switch (choice) {
-            case 1: return 1;
-            case 2: showLevelSelect(); break;
-            case 3: showControlsMenu(); break;
-            case 4: {
-                gotoxy(12,1);
-                std::cout << "Highest score displayed. Press ENTER to return to menu.";
-                restoreTerminal(); { std::string tmp; std::getline(std::cin, tmp); } setupTerminal();
-                break;
+    void run() {
+        while (true) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h != tail.load(std::memory_order_acquire)) {
+                std::function<void()> job = std::move(slots[h % CAPACITY]);
+                slots[h % CAPACITY] = nullptr;
+                head.store(h + 1, std::memory_order_release);
+                { std::lock_guard<std::mutex> guard(wakeLock); }
+                space.notify_one();
+                job();
+                continue;
             }
-            case 5: return 5;
-            default:
-                gotoxy(12,1);
-                std::cout << "Invalid choice. Press ENTER to continue...";
-                restoreTerminal(); { std::string tmp; std::getline(std::cin, tmp); } setupTerminal();
-                break;
+            std::unique_lock<std::mutex> lock(wakeLock);
+            if (stopping && h == tail.load(std::memory_order_acquire)) break;
+            wake.wait(lock, [&] { return stopping || h != tail.load(std::memory_order_acquire); });
         }
+        std::lock_guard<std::mutex> guard(wakeLock);
+        finished = true;
+        finishedCv.notify_all();
     }
-}
-
-// --- Main Game ---
-void gameLoop() {
-    gameOver = false;
-    score = 0;
-    playerX = START_PLAYER_X;
-    obstacles.clear();
-
-    std::cout << CLEAR_SCREEN;
-    hideCursor();
+};
+IoWorker ioWorker;
 
-    int msDuration = 120 - (difficultyLevel * 20);
-    if (msDuration < 20) msDuration = 20;
-    const std::chrono::milliseconds updateDuration(msDuration);
+// --- High Score Persistence ---
+void clearLeaderboard() {
+    std::memset(&leaderboard, 0, sizeof(leaderboard));
+    std::memcpy(leaderboard.magic, "TRHS", 4);
+    leaderboard.version = LEADERBOARD_VERSION;
+    leaderboard.levels = LEVEL_COUNT;
+    leaderboard.entriesPerLevel = LEADERBOARD_SIZE;
+}
 
-    auto lastUpdateTime = std::chrono::steady_clock::now();
+bool leaderboardValid(const Leaderboard &table) {
+    return std::memcmp(table.magic, "TRHS", 4) == 0 && table.version == LEADERBOARD_VERSION &&
+           table.levels == LEVEL_COUNT && table.entriesPerLevel == LEADERBOARD_SIZE;
+}
 
-    while (!gameOver) {
-        std::string input = getInputSequence();
-        if (!input.empty()) {
-            if (input == moveLeftKey) {
-                if (playerX > 2) playerX--;
-            } else if (input == moveRightKey) {
-                if (playerX < TRACK_WIDTH + 1) playerX++;
-            } else if (input == "q" || input == "Q" || input == "\x03") {
-                gameOver = true;
+// Map the file read-only and copy the table out; false if missing or invalid
+bool mapLeaderboard(const std::string &path) {
+    bool ok = false;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart == (LONGLONG)sizeof(Leaderboard)) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) {
+            const void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(Leaderboard));
+            if (view) {
+                const Leaderboard *table = static_cast<const Leaderboard *>(view);
+                if (leaderboardValid(*table)) { leaderboard = *table; ok = true; }
+                UnmapViewOfFile(view);
             }
+            CloseHandle(mapping);
         }
-
-        auto currentTime = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - lastUpdateTime);
-        if (elapsed >= updateDuration) {
-            updateObstacles();
-            checkCollision();
-            lastUpdateTime = currentTime;
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size == (off_t)sizeof(Leaderboard)) {
+        void *view = mmap(nullptr, sizeof(Leaderboard), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) {
+            const Leaderboard *table = static_cast<const Leaderboard *>(view);
+            if (leaderboardValid(*table)) { leaderboard = *table; ok = true; }
+            munmap(view, sizeof(Leaderboard));
+        }
+    }
+    close(fd);
+#endif
+    // Names are printed as C strings; a corrupt or hand-edited file may
+    // not terminate them
+    if (ok) {
+        for (auto &level : leaderboard.entries) {
+            for (ScoreEntry &entry : level) entry.name[PLAYER_NAME_LEN - 1] = '\0';
         }
+    }
+    return ok;
+}
 
-        draw();
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+// Write the table to a temporary file, flush it to disk, rename it over the
+// old one and flush the directory, so a crash or power cut at any point
+// leaves a complete file behind (old or new). On Windows the rename is
+// made durable by MOVEFILE_WRITE_THROUGH.
+bool saveLeaderboard(const Leaderboard &table, const std::string &path = LEADERBOARD_FILE) {
+    const std::string tmpPath = path + ".tmp";
+    const char *data = reinterpret_cast<const char *>(&table);
+#ifdef _WIN32
+    HANDLE file = CreateFileA(tmpPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    DWORD written = 0;
+    bool ok = WriteFile(file, data, (DWORD)sizeof(leaderboard), &written, nullptr) &&
+              written == sizeof(leaderboard) && FlushFileBuffers(file);
+    CloseHandle(file);
+    if (ok) ok = MoveFileExA(tmpPath.c_str(), path.c_str(),
+                             MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    size_t done = 0;
+    while (done < sizeof(leaderboard)) {
+        ssize_t w = write(fd, data + done, sizeof(leaderboard) - done);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        done += (size_t)w;
     }
+    bool ok = done == sizeof(leaderboard) && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (ok) ok = rename(tmpPath.c_str(), path.c_str()) == 0;
+    if (ok) {
+        // The rename lives in the directory; sync that too or a power cut
+        // can still bring the old file back
+        size_t slash = path.find_last_of('/');
+        std::string dir = slash == std::string::npos ? "." : path.substr(0, slash ? slash : 1);
+        int dirFd = open(dir.c_str(), O_RDONLY);
+        ok = dirFd >= 0 && fsync(dirFd) == 0;
+        if (dirFd >= 0) close(dirFd);
+    }
+#endif
+    if (!ok) std::remove(tmpPath.c_str());
+    return ok;
+}
 
-    saveHighestScore();
+long long highestScore(int level) {
+    if (level < 1 || level > LEVEL_COUNT) return 0;
+    return leaderboard.entries[level - 1][0].score;
 }
 
-// --- main ---
-int main() {
-    std::srand((unsigned)std::time(nullptr));
-    loadHighestScore();
+// Insert score into its level's table if it ranks; returns the 1-based
+// rank, or 0 if it did not make the table
+int insertScore(int level, long long score, const std::string &name, int64_t timestamp) {
+    if (level < 1 || level > LEVEL_COUNT || score <= 0) return 0;
+    ScoreEntry *table = leaderboard.entries[level - 1];
+    int pos = 0;
+    while (pos < LEADERBOARD_SIZE && table[pos].score >= score) pos++;
+    if (pos == LEADERBOARD_SIZE) return 0;
+    std::memmove(table + pos + 1, table + pos, (LEADERBOARD_SIZE - 1 - pos) * sizeof(ScoreEntry));
+    ScoreEntry &entry = table[pos];
+    std::memset(&entry, 0, sizeof(entry));
+    entry.score = score;
+    entry.timestamp = timestamp;
+    std::strncpy(entry.name, name.c_str(), PLAYER_NAME_LEN - 1);
+    return pos + 1;
+}
 
-    setupTerminal();
+void loadHighestScore() {
+    if (mapLeaderboard(LEADERBOARD_FILE)) return;
+    clearLeaderboard();
+    // First run after upgrading: carry the old single record over, filed
+    // under level 1 since the old file did not say which level it was
+    std::ifstream file(HIGHSCORE_FILE);
+    long long legacy = 0;
+    if (file.is_open() && (file >> legacy) && legacy > 0) {
+        insertScore(1, legacy, "(legacy)", 0);
+        saveLeaderboard(leaderboard);
+    }
+}
 
-    int menuChoice = 0;
-    try {
-        do {
-            menuChoice = showMenu();
-            if (menuChoice == 1) {
-                gameLoop();
-                restoreTerminal();
-                std::cout << "\n\n  *** GAME OVER ***\n";
-                std::cout << "  Final Score: " << score << "\n";
-                std::cout << "  Highest Score: " << highestScore << "\n\n";
-                std::cout << "Press ENTER to return to the main menu...";
-                std::cin.get();
-                setupTerminal();
-            }
-        } while (menuChoice != 5);
+// Returns the rank the score reached on its level's table (0 if none).
+// The file is written in the background from a snapshot of the table.
+int saveHighestScore(int level, long long score) {
+    int rank = insertScore(level, score, settings.playerName, (int64_t)std::time(nullptr));
+    if (rank > 0) {
+        Leaderboard snapshot = leaderboard;
+        ioWorker.post([snapshot] { saveLeaderboard(snapshot); });
+    }
+    return rank;
+}
+
+// --- Obstacle Kernels ---
+// Sets bit i of mask[i / 32] when lane i has xs[i] == x and rows[i] == row.
+// n must be a multiple of 32.
+void matchLanes(const int16_t *xs, const int16_t *rows, int n,
+                int16_t x, int16_t row, uint32_t *mask) {
+    for (int base = 0; base < n; base += 32) {
+#if defined(CARGAME_SIMD_AVX2)
+        const __m256i vx = _mm256_set1_epi16(x);
+        const __m256i vr = _mm256_set1_epi16(row);
+        __m256i lo = _mm256_and_si256(
+            _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(xs + base)), vx),
+            _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(rows + base)), vr));
+        __m256i hi = _mm256_and_si256(
+            _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(xs + base + 16)), vx),
+            _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)(rows + base + 16)), vr));
+        // packs interleaves 128-bit halves; reorder qwords back to lane order
+        __m256i bytes = _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8);
+        mask[base / 32] = (uint32_t)_mm256_movemask_epi8(bytes);
+#elif defined(CARGAME_SIMD_SSE2)
+        const __m128i vx = _mm_set1_epi16(x);
+        const __m128i vr = _mm_set1_epi16(row);
+        __m128i eq[4];
+        for (int k = 0; k < 4; ++k) {
+            eq[k] = _mm_and_si128(
+                _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(xs + base + 8 * k)), vx),
+                _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(rows + base + 8 * k)), vr));
+        }
+        uint32_t lo = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(eq[0], eq[1]));
+        uint32_t hi = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(eq[2], eq[3]));
+        mask[base / 32] = lo | (hi << 16);
+#elif defined(CARGAME_SIMD_NEON)
+        const int16x8_t vx = vdupq_n_s16(x);
+        const int16x8_t vr = vdupq_n_s16(row);
+        static const uint8_t weights[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+        const uint8x8_t w = vld1_u8(weights);
+        uint32_t bits = 0;
+        for (int k = 0; k < 4; ++k) {
+            uint16x8_t eq = vandq_u16(vceqq_s16(vld1q_s16(xs + base + 8 * k), vx),
+                                      vceqq_s16(vld1q_s16(rows + base + 8 * k), vr));
+            bits |= (uint32_t)vaddv_u8(vand_u8(vmovn_u16(eq), w)) << (8 * k);
+        }
+        mask[base / 32] = bits;
+#else
+        uint32_t bits = 0;
+        for (int k = 0; k < 32; ++k) {
+            if (xs[base + k] == x && rows[base + k] == row) bits |= 1u << k;
+        }
+        mask[base / 32] = bits;
+#endif
+    }
+}
+
+// --- Replays ---
+// A replay is the seed and level plus every player action, stamped with the
+// number of ticks completed before it. Since the tick is deterministic that
+// is enough to reproduce the whole game.
+//
+// File layout (integers are LEB128 varints unless noted):
+//   "TRRP"  version:u8  level:u8  seed:u64 little-endian
+//   mode:u8  width  height                      (version 2 and later)
+//   finalTick  finalScore  eventCount
+//   eventCount x ((tickDelta << 2) | action)
+// Version 1 files are standard games on the fixed track.
+const char REPLAY_MAGIC[4] = {'T', 'R', 'R', 'P'};
+const uint8_t REPLAY_VERSION = 2;
+
+enum ReplayAction : uint8_t { REPLAY_LEFT = 0, REPLAY_RIGHT = 1, REPLAY_QUIT = 2 };
+
+struct ReplayEvent {
+    long long tick;
+    ReplayAction action;
+};
+
+struct Replay {
+    uint64_t seed = 0;
+    int level = 1;
+    int mode = 0;                 // a game type's REPLAY_MODE
+    int width = TRACK_WIDTH;      // track size, without the borders
+    int height = SCREEN_HEIGHT;
+    long long finalTick = 0;
+    long long finalScore = 0;
+    std::vector<ReplayEvent> events;
+};
+
+void appendVarint(std::string &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((char)((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+bool readVarint(const std::string &in, size_t &pos, uint64_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+        uint8_t byte = (uint8_t)in[pos++];
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool saveReplay(const std::string &path, const Replay &replay) {
+    std::string out(REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+    out.push_back((char)REPLAY_VERSION);
+    out.push_back((char)replay.level);
+    for (int i = 0; i < 8; ++i) out.push_back((char)((replay.seed >> (8 * i)) & 0xFF));
+    out.push_back((char)replay.mode);
+    appendVarint(out, (uint64_t)replay.width);
+    appendVarint(out, (uint64_t)replay.height);
+    appendVarint(out, (uint64_t)replay.finalTick);
+    appendVarint(out, (uint64_t)replay.finalScore);
+    appendVarint(out, replay.events.size());
+    long long lastTick = 0;
+    for (const auto &e : replay.events) {
+        appendVarint(out, ((uint64_t)(e.tick - lastTick) << 2) | e.action);
+        lastTick = e.tick;
+    }
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+    file.write(out.data(), (std::streamsize)out.size());
+    return (bool)file;
+}
+
+bool loadReplay(const std::string &path, Replay &replay) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::string in((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (in.size() < 14 || in.compare(0, 4, REPLAY_MAGIC, 4) != 0) return false;
+    uint8_t version = (uint8_t)in[4];
+    if (version < 1 || version > REPLAY_VERSION) return false;
+    replay.level = (uint8_t)in[5];
+    replay.seed = 0;
+    for (int i = 0; i < 8; ++i) replay.seed |= (uint64_t)(uint8_t)in[6 + i] << (8 * i);
+
+    size_t pos = 14;
+    replay.mode = GameState::REPLAY_MODE;
+    replay.width = TRACK_WIDTH;
+    replay.height = SCREEN_HEIGHT;
+    if (version >= 2) {
+        uint64_t width, height;
+        if (pos >= in.size()) return false;
+        replay.mode = (uint8_t)in[pos++];
+        if (!readVarint(in, pos, width) || !readVarint(in, pos, height) ||
+            width > MAX_TRACK_WIDTH || height > MAX_VIEW_ROWS) return false;
+        replay.width = (int)width;
+        replay.height = (int)height;
+    }
+    uint64_t finalTick, finalScore, count;
+    if (!readVarint(in, pos, finalTick) || !readVarint(in, pos, finalScore) ||
+        !readVarint(in, pos, count)) return false;
+    replay.finalTick = (long long)finalTick;
+    replay.finalScore = (long long)finalScore;
+    replay.events.clear();
+    long long tick = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t packed;
+        if (!readVarint(in, pos, packed) || (packed & 3) > REPLAY_QUIT) return false;
+        tick += (long long)(packed >> 2);
+        replay.events.push_back({tick, (ReplayAction)(packed & 3)});
+    }
+    return true;
+}
+
+// File for the n-th game recorded this session: the first keeps the name
+// given to --record, later ones get "-n" before the extension
+// (run.trr, run-2.trr, run-3.trr, ...)
+std::string recordPath(const std::string &file, int n) {
+    if (n <= 1) return file;
+    size_t dot = file.rfind('.');
+    size_t slash = file.find_last_of("/\\");
+    if (dot == std::string::npos || dot == 0 || (slash != std::string::npos && dot <= slash + 1)) {
+        dot = file.size();
+    }
+    return file.substr(0, dot) + "-" + std::to_string(n) + file.substr(dot);
+}
+
+// --- Game Logic ---
+template <int W, int H>
+void TrackGame<W, H>::reset(int level) {
+    std::memset(carX, 0, sizeof(carX));
+    std::memset(carRow, 0, sizeof(carRow));
+    obstacleHead = 0;
+    obstacleCount = 0;
+    scrollRow = 0;
+    playerX = width() / 2 + 1;
+    score = 0;
+    gameOver = false;
+    difficultyLevel = level;
+}
+
+// Move the player one lane left (dir < 0) or right (dir > 0).
+// Returns true if the position changed.
+template <int W, int H>
+bool TrackGame<W, H>::movePlayer(int dir) {
+    if (dir < 0 && playerX > 2) { playerX--; return true; }
+    if (dir > 0 && playerX < width() + 1) { playerX++; return true; }
+    return false;
+}
+
+template <int W, int H>
+void TrackGame<W, H>::updateObstacles() {
+    scrollRow++;
+    while (obstacleCount > 0 && screenY(slot(0)) > height()) {
+        int gone = slot(0);
+        carX[gone] = 0;
+        obstacleHead = (obstacleHead + 1) & (OBSTACLE_CAPACITY - 1);
+        obstacleCount--;
+        score += 10;
+    }
+    bool shouldSpawn = (rng.below(10) < spawnChance && obstacleCount == 0) ||
+                       (obstacleCount > 0 && screenY(slot(obstacleCount - 1)) > spawnGap);
+    if (shouldSpawn && obstacleCount < OBSTACLE_CAPACITY) {
+        int newX = rng.below(width()) + 2;
+        int s = slot(obstacleCount);
+        carX[s] = (int16_t)newX;
+        carRow[s] = (int16_t)(uint16_t)scrollRow;
+        obstacleCount++;
+    }
+}
+
+// Crash if any live car is on the player's row and column. One kernel pass
+// over the obstacle lanes.
+template <int W, int H>
+void TrackGame<W, H>::checkCollision() {
+    uint32_t hits[OBSTACLE_CAPACITY / 32];
+    matchLanes(carX, carRow, OBSTACLE_CAPACITY, (int16_t)playerX,
+               (int16_t)(uint16_t)(scrollRow - height() + 1), hits);
+    for (uint32_t word : hits) {
+        if (word) { gameOver = true; break; }
+    }
+}
+
+// One fixed step with an explicit move (-1, 0, +1) decided beforehand
+template <int W, int H>
+void TrackGame<W, H>::tick(int move) {
+    movePlayer(move);
+    updateObstacles();
+    checkCollision();
+}
+
+std::chrono::milliseconds levelTickDuration(int level) {
+    int msDuration = 120 - (level * 20);
+    if (msDuration < 20) msDuration = 20;
+    return std::chrono::milliseconds(msDuration);
+}
+
+template <int W, int H>
+std::chrono::milliseconds TrackGame<W, H>::tickDuration() const {
+    return levelTickDuration(difficultyLevel);
+}
+
+// --- Endurance Mode ---
+void EnduranceGame::reset(int level) {
+    trackWidth = std::min(std::max(trackWidth, MIN_TRACK_WIDTH), MAX_TRACK_WIDTH);
+    viewRows = std::min(std::max(viewRows, MIN_VIEW_ROWS), MAX_VIEW_ROWS);
+    lanes = std::min(std::max(trackWidth * 6 / 10 / LANE_WIDTH, 2), MAX_LANES);
+    roadCenter = trackWidth / 2 + 1;
+    roadDrift = 0;
+    trafficGap = lanes / 2;
+    score = 0;
+    gameOver = false;
+    difficultyLevel = level;
+
+    // The player starts on world row 0, at the bottom of the first view
+    for (auto &chunk : chunks) chunk.index = -1;
+    nextChunk = 0;
+    scrollRow = viewRows - 1;
+    while (nextChunk <= scrollRow / CHUNK_ROWS + 1) generateChunk(nextChunk++);
+    const TrackChunk &start = chunkFor(0);
+    playerX = start.roadLeft[0] + start.roadWidth[0] / 2;
+}
+
+// Lay out the road and traffic for one chunk. Chunks are generated strictly
+// in order from the game's own generator, so a seed always builds the same
+// world however it is driven.
+void EnduranceGame::generateChunk(long long index) {
+    TrackChunk &chunk = chunks[index % ENDURANCE_CHUNKS];
+    chunk.index = index;
+    const int roadWidth = lanes * LANE_WIDTH;
+    const int half = roadWidth / 2;
+    const int minCenter = 2 + half;                          // road starts at column 2
+    const int maxCenter = trackWidth + 2 - roadWidth + half; // ... and ends at trackWidth + 1
+    const int carChance = 10 + 8 * difficultyLevel;          // percent per lane
+
+    for (int i = 0; i < CHUNK_ROWS; ++i) {
+        long long row = index * CHUNK_ROWS + i;
+        // The road wanders one column every other row, changing heading
+        // every 8 rows and bouncing off the track edges
+        if (row % 8 == 0) roadDrift = rng.below(3) - 1;
+        if (row % 2 == 0) roadCenter += roadDrift;
+        if (roadCenter <= minCenter) { roadCenter = minCenter; roadDrift = 1; }
+        if (roadCenter >= maxCenter) { roadCenter = maxCenter; roadDrift = -1; }
+        int roadLeft = roadCenter - half;
+        chunk.roadLeft[i] = (int16_t)roadLeft;
+        chunk.roadWidth[i] = (int16_t)roadWidth;
+        chunk.carCount[i] = 0;
+        chunk.cars[i].reset();
+
+        // Nothing in the first view; after that a row of traffic every
+        // TRAFFIC_SPACING rows with at least one lane open. The open lane
+        // moves by at most one lane per row so it can always be reached.
+        if (row < viewRows || row % TRAFFIC_SPACING != 0) continue;
+        trafficGap = std::min(std::max(trafficGap + rng.below(3) - 1, 0), lanes - 1);
+        for (int lane = 0; lane < lanes; ++lane) {
+            if (lane == trafficGap || rng.below(100) >= carChance) continue;
+            for (int c = 0; c < LANE_WIDTH; ++c) chunk.cars[i].set(roadLeft + lane * LANE_WIDTH + c);
+            chunk.carCount[i]++;
+        }
+    }
+}
+
+bool EnduranceGame::movePlayer(int dir) {
+    if (dir < 0 && playerX > 2) { playerX--; return true; }
+    if (dir > 0 && playerX < trackWidth + 1) { playerX++; return true; }
+    return false;
+}
+
+void EnduranceGame::updateObstacles() {
+    scrollRow++;
+    // Score the row that just left the screen before its chunk can be reused
+    long long gone = scrollRow - viewRows;
+    score += 10 * chunkFor(gone).carCount[gone % CHUNK_ROWS];
+    while (nextChunk <= scrollRow / CHUNK_ROWS + 1) generateChunk(nextChunk++);
+}
+
+// Crash into traffic or by leaving the road
+void EnduranceGame::checkCollision() {
+    long long row = playerRow();
+    const TrackChunk &chunk = chunkFor(row);
+    int i = (int)(row % CHUNK_ROWS);
+    if (playerX < chunk.roadLeft[i] || playerX >= chunk.roadLeft[i] + chunk.roadWidth[i] ||
+        chunk.cars[i].test(playerX)) {
+        gameOver = true;
+    }
+}
+
+void EnduranceGame::tick(int move) {
+    movePlayer(move);
+    updateObstacles();
+    checkCollision();
+}
+
+std::chrono::milliseconds EnduranceGame::tickDuration() const {
+    return levelTickDuration(difficultyLevel);
+}
+
+// --- Rendering ---
+// Call right after the screen has been cleared: the terminal is blank, so
+// the next frame only has to send non-blank cells.
+void resetFrontBuffer() {
+    std::fill(frontBuffer.begin(), frontBuffer.end(), ' ');
+}
+
+// Decimal digits of a non-negative value, written backwards from end;
+// returns where they start
+char *writeDigits(char *end, unsigned long long value) {
+    do { *--end = (char)('0' + value % 10); value /= 10; } while (value);
+    return end;
+}
+
+// Sent for every changed run, so it is built by hand rather than by printf
+void appendCursorMove(std::string &out, int row, int col) {
+    char seq[24];
+    char *end = seq + sizeof(seq);
+    *--end = 'H';
+    end = writeDigits(end, (unsigned long long)col);
+    *--end = ';';
+    end = writeDigits(end, (unsigned long long)row);
+    *--end = '[';
+    *--end = '\033';
+    out.append(end, (size_t)(seq + sizeof(seq) - end));
+}
+
+// Same row, n columns right: shorter than a full move
+void appendCursorForward(std::string &out, int n) {
+    char seq[24];
+    char *end = seq + sizeof(seq);
+    *--end = 'C';
+    end = writeDigits(end, (unsigned long long)n);
+    *--end = '[';
+    *--end = '\033';
+    out.append(end, (size_t)(seq + sizeof(seq) - end));
+}
+
+// Start of viewport row `row` in a composed frame (backBuffer or a render
+// thread snapshot). Track rows scroll with the viewport; the status and HUD
+// rows don't.
+const char *viewportRow(const char *cells, int row) {
+    const int trackRowsShown = viewportRows - 2;
+    const int firstTrackRow = frameRows - 2 - trackRowsShown;
+    const char *start = cells + (size_t)(firstTrackRow + row) * frameCols;
+    return row < trackRowsShown ? start + viewportColOffset : start;
+}
+
+// Scroll the viewport sideways to keep frame column focusCol in view
+void scrollViewport(int focusCol) {
+    if (viewportCols < frameTrackCols) {
+        viewportColOffset = std::min(std::max(focusCol - viewportCols / 2, 0),
+                                     frameTrackCols - viewportCols);
+    } else {
+        viewportColOffset = 0;
+    }
+}
+
+// --- Windows Console Backend ---
+// conhost parses VT sequences slowly, so on Windows frames skip them: the
+// changed rectangle of the viewport is copied into a CHAR_INFO buffer and
+// written with one WriteConsoleOutputW call, into a screen buffer of our
+// own so the menus' scrollback is left alone. With --double-buffer there
+// are two such buffers; each frame is written whole into the hidden one,
+// which is then made active.
+#ifdef _WIN32
+struct ConsoleRenderer {
+    HANDLE buffers[2] = {nullptr, nullptr};
+    int hidden = 0;                   // buffer the next frame goes into
+    std::vector<CHAR_INFO> cells;
+
+    HANDLE createBuffer() {
+        HANDLE h = CreateConsoleScreenBuffer(GENERIC_READ | GENERIC_WRITE,
+                                             FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                             nullptr, CONSOLE_TEXTMODE_BUFFER, nullptr);
+        if (h == INVALID_HANDLE_VALUE) return nullptr;
+        CONSOLE_CURSOR_INFO info = {1, FALSE};
+        SetConsoleCursorInfo(h, &info);
+        return h;
+    }
+
+    // Switch output to our screen buffer(s); false leaves the VT path in use
+    bool begin() {
+        buffers[0] = createBuffer();
+        if (!buffers[0]) return false;
+        if (consoleDoubleBuffer) buffers[1] = createBuffer();
+        hidden = buffers[1] ? 1 : 0;
+        SetConsoleActiveScreenBuffer(buffers[0]);
+        hGameOut = buffers[0];
+        return true;
+    }
+
+    void end() {
+        if (!hGameOut) return;
+        if (!hStdout) hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
+        SetConsoleActiveScreenBuffer(hStdout);
+        for (HANDLE &h : buffers) {
+            if (h) CloseHandle(h);
+            h = nullptr;
+        }
+        hGameOut = nullptr;
+    }
+
+    void clear() {
+        for (HANDLE h : buffers) {
+            if (!h) continue;
+            CONSOLE_SCREEN_BUFFER_INFO info;
+            if (!GetConsoleScreenBufferInfo(h, &info)) continue;
+            DWORD written = 0;
+            FillConsoleOutputCharacterW(h, L' ', (DWORD)info.dwSize.X * info.dwSize.Y, {0, 0}, &written);
+        }
+    }
+
+    void present(const char *frame) {
+        // Bounding box of the changed cells, folded into frontBuffer as we go
+        int top = viewportRows, bottom = -1, left = viewportCols, right = -1;
+        for (int row = 0; row < viewportRows; ++row) {
+            const char *back = viewportRow(frame, row);
+            char *front = frontBuffer.data() + (size_t)row * viewportCols;
+            for (int col = 0; col < viewportCols; ++col) {
+                if (back[col] == front[col]) continue;
+                front[col] = back[col];
+                top = std::min(top, row);
+                bottom = row;
+                left = std::min(left, col);
+                right = std::max(right, col);
+            }
+        }
+        if (bottom < 0) {
+            if (profiler.enabled) profiler.frameSent(0, 0);
+            return;
+        }
+        // The hidden buffer last showed the frame before the previous one,
+        // so a flip has to rewrite the whole viewport
+        if (buffers[1]) {
+            top = 0; bottom = viewportRows - 1;
+            left = 0; right = viewportCols - 1;
+        }
+
+        const int width = right - left + 1;
+        const int height = bottom - top + 1;
+        cells.resize((size_t)width * height);
+        for (int row = 0; row < height; ++row) {
+            const char *src = frontBuffer.data() + (size_t)(top + row) * viewportCols + left;
+            CHAR_INFO *dst = cells.data() + (size_t)row * width;
+            for (int col = 0; col < width; ++col) {
+                dst[col].Char.UnicodeChar = (WCHAR)(unsigned char)src[col];
+                dst[col].Attributes = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+            }
+        }
+        SMALL_RECT region = {(SHORT)left, (SHORT)top, (SHORT)right, (SHORT)bottom};
+        if (profiler.enabled) profiler.frameSent(cells.size() * sizeof(CHAR_INFO), 1);
+        ScopedTimer timer(PHASE_FLUSH);
+        HANDLE target = buffers[hidden];
+        WriteConsoleOutputW(target, cells.data(), {(SHORT)width, (SHORT)height}, {0, 0}, &region);
+        if (buffers[1]) {
+            SetConsoleActiveScreenBuffer(target);
+            hGameOut = target;
+            hidden ^= 1;
+        }
+    }
+};
+ConsoleRenderer consoleRenderer;
+#endif
+
+// Diff the viewport of a composed frame against frontBuffer into frameOut.
+// Each changed run becomes one cursor move plus its cells, so the whole
+// frame can go out in a single write. focusCol is the frame column to keep
+// in view; with skipHud the HUD row is left as the terminal shows it.
+void diffFrame(const char *cells, int focusCol, bool skipHud = false) {
+    scrollViewport(focusCol);
+    frameOut.clear();
+    int cursorRow = -1, cursorCol = 0; // where the last run left the cursor
+    const int rows = skipHud ? viewportRows - 1 : viewportRows;
+    for (int row = 0; row < rows; ++row) {
+        const char *back = viewportRow(cells, row);
+        char *front = frontBuffer.data() + (size_t)row * viewportCols;
+        int col = 0;
+        while (col < viewportCols) {
+            if (back[col] == front[col]) { ++col; continue; }
+            int runEnd = col + 1;
+            int scan = runEnd;
+            while (scan < viewportCols) {
+                if (back[scan] != front[scan]) runEnd = ++scan;
+                else if (scan - runEnd < RUN_MERGE_GAP) ++scan;
+                else break;
+            }
+            if (row == cursorRow) appendCursorForward(frameOut, col - cursorCol);
+            else appendCursorMove(frameOut, row + 1, col + 1);
+            frameOut.append(back + col, (size_t)(runEnd - col));
+            std::memcpy(front + col, back + col, (size_t)(runEnd - col));
+            col = runEnd;
+            cursorRow = row;
+            cursorCol = runEnd;
+        }
+    }
+}
+
+// Send backBuffer from the game thread
+void presentFrame(int focusCol) {
+#ifdef _WIN32
+    if (hGameOut) {
+        scrollViewport(focusCol);
+        consoleRenderer.present(backBuffer.data());
+        return;
+    }
+#endif
+    diffFrame(backBuffer.data(), focusCol);
+    int writes = 0;
+    if (!frameOut.empty() && !discardFrames) {
+        ScopedTimer timer(PHASE_FLUSH);
+        writes = writeOut(frameOut.data(), frameOut.size());
+    }
+    if (profiler.enabled) profiler.frameSent(frameOut.size(), writes);
+}
+
+// --- Render Thread ---
+// Interactive games hand finished frames to a render thread, so a write
+// stalled by a slow terminal (SSH backpressure) never delays a tick. The
+// game thread copies backBuffer into a snapshot and publishes it through a
+// lock-free triple buffer; the render thread always takes the newest one,
+// and frames it had no time to send are simply overwritten. From start()
+// to stop() the render thread owns frontBuffer, frameOut, the viewport and
+// outputSink.
+struct FrameSnapshot {
+    std::vector<char> cells;  // frameCols x frameRows, as composed
+    int focusCol = 0;
+    int terminalCols = 0;     // terminal size the game thread last saw
+    int terminalRows = 0;
+    unsigned repaint = 0;     // bumped by repaintAll()
+};
+
+class FrameTripleBuffer {
+public:
+    FrameSnapshot slots[3];
+
+    FrameSnapshot &writeSlot() { return slots[writeIndex]; }
+    FrameSnapshot &readSlot() { return slots[readIndex]; }
+
+    // Writer: swap the filled write slot into the middle
+    void publish() {
+        int old = middle.exchange(writeIndex | FRESH, std::memory_order_acq_rel);
+        writeIndex = old & INDEX_MASK;
+    }
+
+    bool fresh() const { return (middle.load(std::memory_order_acquire) & FRESH) != 0; }
+
+    // Reader: swap the middle slot into readSlot() if it holds a new frame
+    bool take() {
+        if (!fresh()) return false;
+        int old = middle.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = old & INDEX_MASK;
+        return true;
+    }
+
+    void reset() {
+        middle.store(1, std::memory_order_relaxed);
+        writeIndex = 0;
+        readIndex = 2;
+    }
+
+private:
+    static const int INDEX_MASK = 3;
+    static const int FRESH = 4;   // set while the middle slot is unread
+    std::atomic<int> middle{1};   // slot between the two threads, plus FRESH
+    int writeIndex = 0;           // game thread only
+    int readIndex = 2;            // render thread only
+};
+
+class RenderThread {
+public:
+    bool running() const { return active; }
+
+    void start() {
+        if (active) return;
+        for (FrameSnapshot &slot : frames.slots) slot.cells.assign(backBuffer.size(), ' ');
+        frames.reset();
+        repaintCount = shownRepaint = 0;
+        stopping = false;
+        pressureFrames = 0;
+        outputSink.begin(frameOut.capacity() + CLEAR_SCREEN.size());
+        active = true;
+        thread = std::thread([this] { run(); });
+    }
+
+    void publish(int focusCol) {
+        FrameSnapshot &slot = frames.writeSlot();
+        std::memcpy(slot.cells.data(), backBuffer.data(), backBuffer.size());
+        slot.focusCol = focusCol;
+        slot.terminalCols = terminalCols;
+        slot.terminalRows = terminalRows;
+        slot.repaint = repaintCount;
+        frames.publish(); // an unsent frame in the middle is dropped here
+        { std::lock_guard<std::mutex> guard(wakeLock); }
+        wake.notify_one();
+        collectStats();
+    }
+
+    // The next frame published clears the screen and refits the viewport
+    void requestRepaint() { repaintCount++; }
+
+    // Send the last published frame, then join the thread
+    void stop() {
+        if (!active) return;
+        {
+            std::lock_guard<std::mutex> guard(wakeLock);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+        outputSink.end();
+        active = false;
+        collectStats();
+    }
+
+private:
+    FrameTripleBuffer frames;
+    bool active = false;             // game thread only
+    unsigned repaintCount = 0;       // game thread only
+    unsigned shownRepaint = 0;       // render thread only
+    int pressureFrames = 0;          // render thread only: frames left without the HUD
+    std::mutex wakeLock;
+    std::condition_variable wake;
+    bool stopping = false;           // guarded by wakeLock
+    std::thread thread;
+
+    // After the terminal pushes back, this many frames go out without the
+    // HUD row; a backlog is waited on this long at a time
+    static const int PRESSURE_FRAMES = 30;
+    static const int BACKLOG_WAIT_MS = 100;
+
+    // Flush timings travel back to the game thread, which owns the
+    // profiler, through a single-producer/single-consumer ring
+    struct FlushSample {
+        long long startNs;
+        long long endNs;
+        size_t bytes;
+        int writes;
+        bool frame;   // false for a backlog drain between frames
+    };
+    static const size_t STATS_CAPACITY = 64;
+    FlushSample samples[STATS_CAPACITY];
+    std::atomic<size_t> statsHead{0}; // owned by the game thread
+    std::atomic<size_t> statsTail{0}; // owned by the render thread
+
+    void collectStats() {
+        size_t h = statsHead.load(std::memory_order_relaxed);
+        size_t t = statsTail.load(std::memory_order_acquire);
+        for (; h != t; ++h) {
+            const FlushSample &sample = samples[h % STATS_CAPACITY];
+            if (sample.frame) profiler.frameSent(sample.bytes, sample.writes);
+            if (sample.bytes) profiler.record(PHASE_FLUSH, sample.startNs, sample.endNs);
+        }
+        statsHead.store(h, std::memory_order_release);
+    }
+
+    void present(const FrameSnapshot &frame) {
+        bool repaint = frame.repaint != shownRepaint;
+        if (repaint) {
+            shownRepaint = frame.repaint;
+            fitViewport(frame.terminalCols, frame.terminalRows);
+        }
+        diffFrame(frame.cells.data(), frame.focusCol, pressureFrames > 0);
+        if (repaint) frameOut.insert(0, CLEAR_SCREEN);
+        flush(frameOut.data(), frameOut.size(), true);
+    }
+
+    void flush(const char *data, size_t len, bool frame) {
+        long long start = profiler.enabled ? nowNs() : 0;
+        outputSink.send(data, len);
+        if (outputSink.backlogged()) pressureFrames = PRESSURE_FRAMES;
+        else if (frame && pressureFrames > 0) pressureFrames--;
+        if (!profiler.enabled) return;
+        size_t t = statsTail.load(std::memory_order_relaxed);
+        if (t - statsHead.load(std::memory_order_acquire) == STATS_CAPACITY) return; // sample lost
+        samples[t % STATS_CAPACITY] = {start, nowNs(), outputSink.lastBytes, outputSink.lastWrites, frame};
+        statsTail.store(t + 1, std::memory_order_release);
+    }
+
+    void run() {
+#ifndef _WIN32
+        // Resizes must interrupt the game thread's wait for input, not a write
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGWINCH);
+        pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+#endif
+        while (true) {
+            if (outputSink.backlogged()) {
+                // Frames published meanwhile replace each other; only the
+                // newest is diffed once the terminal has caught up
+                outputSink.waitWritable(BACKLOG_WAIT_MS);
+                flush(nullptr, 0, false);
+                continue;
+            }
+            if (frames.take()) {
+                present(frames.readSlot());
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wakeLock);
+            if (stopping && !frames.fresh()) break;
+            wake.wait(lock, [this] { return stopping || frames.fresh(); });
+        }
+    }
+};
+RenderThread renderThread;
+
+// Call when a game starts and ends drawing. Frames use the console backend
+// on Windows when it is available, VT sequences otherwise; VT frames go
+// through the render thread unless --sync-render is given. The console
+// backend writes to a local console that never backs up, so it stays on the
+// game thread.
+void beginFrames() {
+#ifdef _WIN32
+    consoleRenderer.begin();
+    if (hGameOut) return;
+#endif
+    if (!syncRender) renderThread.start();
+}
+
+void endFrames() {
+    renderThread.stop();
+#ifdef _WIN32
+    bool console = hGameOut != nullptr;
+    consoleRenderer.end();
+    if (console) return;
+#endif
+    // Diffs leave the cursor wherever the last changed run ended; put it
+    // below the frame so whatever is printed next does not land on it
+    gotoxy(viewportRows + 1, 1);
+}
+
+// After a resize: clear the screen and size the viewport to the terminal,
+// so the next frame is one full repaint and later ones are diffs again
+void repaintAll() {
+    frameDirty = true;
+    if (renderThread.running()) {
+        renderThread.requestRepaint();
+        return;
+    }
+    fitViewport(terminalCols, terminalRows);
+#ifdef _WIN32
+    if (hGameOut) {
+        consoleRenderer.clear();
+        return;
+    }
+#endif
+    writeOut(CLEAR_SCREEN.data(), CLEAR_SCREEN.size());
+}
+
+// Status bar text after the score, rebuilt only when the level or the
+// controls differ from the ones it was made for. A fixed buffer, so a
+// rebuild mid-game does not touch the heap either.
+char statusSuffix[FRAME_COLS];
+size_t statusSuffixLen = 0;
+int statusLevel = -1;
+KeyCode statusLeftKey = KEY_NONE;
+KeyCode statusRightKey = KEY_NONE;
+
+const char *statusTail(int level, size_t &len) {
+    if (level != statusLevel || settings.moveLeftKey != statusLeftKey ||
+        settings.moveRightKey != statusRightKey) {
+        char leftName[KEY_NAME_LEN], rightName[KEY_NAME_LEN];
+        int n = std::snprintf(statusSuffix, sizeof(statusSuffix), " | Level: %d | Controls: Left=%s Right=%s",
+                              level, formatKeyName(settings.moveLeftKey, leftName),
+                              formatKeyName(settings.moveRightKey, rightName));
+        statusSuffixLen = n < 0 ? 0 : std::min((size_t)n, sizeof(statusSuffix) - 1);
+        statusLevel = level;
+        statusLeftKey = settings.moveLeftKey;
+        statusRightKey = settings.moveRightKey;
+    }
+    len = statusSuffixLen;
+    return statusSuffix;
+}
+
+// Fill the status bar and HUD rows below the track and send the frame. The
+// template already blanked both rows; only the score digits are formatted.
+void finishFrame(long long score, int level, int playerCol) {
+    char *statusRow = backBuffer.data() + (size_t)(frameRows - 2) * frameCols;
+    char *hudRow = backBuffer.data() + (size_t)(frameRows - 1) * frameCols;
+    static const char SCORE_LABEL[] = "Score: ";
+    char status[FRAME_COLS];
+    int len = (int)sizeof(SCORE_LABEL) - 1;
+    std::memcpy(status, SCORE_LABEL, (size_t)len);
+    char digits[24];
+    char *first = writeDigits(digits + sizeof(digits), score < 0 ? 0 : (unsigned long long)score);
+    std::memcpy(status + len, first, (size_t)(digits + sizeof(digits) - first));
+    len += (int)(digits + sizeof(digits) - first);
+    std::memcpy(statusRow, status, (size_t)len);
+    size_t tailLen;
+    const char *tail = statusTail(level, tailLen);
+    std::memcpy(statusRow + len, tail, std::min(tailLen, (size_t)(frameCols - len)));
+    if (profiler.enabled && profiler.hudVisible) {
+        const char *hud = profiler.hudLine();
+        std::memcpy(hudRow, hud, std::min(std::strlen(hud), (size_t)frameCols));
+    }
+    if (renderThread.running()) renderThread.publish(playerCol);
+    else presentFrame(playerCol);
+}
+
+// Cars and player of a standard game over a track that already has its
+// borders and road, rows `stride` chars apart
+template <int W, int H>
+void patchTrack(const TrackGame<W, H> &game, char *cells, int stride) {
+    const int height = game.height();
+    for (int i = 0; i < game.obstacleCount; ++i) {
+        int s = game.slot(i);
+        int y = game.screenY(s);
+        if (y >= 1 && y <= height) cells[(size_t)(y - 1) * stride + game.carX[s] - 1] = OBSTACLE_CHAR;
+    }
+    cells[(size_t)(height - 1) * stride + game.playerX - 1] = PLAYER_CHAR;
+}
+
+// Track cells of a standard game, rows `stride` chars apart. Shared by the
+// terminal renderer and the network server.
+template <int W, int H>
+void composeTrack(const TrackGame<W, H> &game, char *cells, int stride) {
+    const int width = game.width();
+    for (int y = 1; y <= game.height(); ++y) {
+        char *row = cells + (size_t)(y - 1) * stride;
+        row[0] = BORDER_CHAR;
+        std::memset(row + 1, ROAD_CHAR, (size_t)width);
+        row[width + 1] = BORDER_CHAR;
+    }
+    patchTrack(game, cells, stride);
+}
+
+template <int W, int H>
+void draw(const TrackGame<W, H> &game) {
+    ScopedTimer timer(PHASE_DRAW);
+    std::copy(frameTemplate.begin(), frameTemplate.end(), backBuffer.begin());
+    patchTrack(game, backBuffer.data(), frameCols);
+    finishFrame(game.score, game.difficultyLevel, game.playerX - 1);
+}
+
+// The road moves every frame, so only the borders come from the template
+void draw(const EnduranceGame &game) {
+    ScopedTimer timer(PHASE_DRAW);
+    std::copy(frameTemplate.begin(), frameTemplate.end(), backBuffer.begin());
+    const int width = game.trackWidth;
+    for (int y = 1; y <= game.viewRows; ++y) {
+        char *row = backBuffer.data() + (size_t)(y - 1) * frameCols;
+        long long worldRow = game.scrollRow - y + 1;
+        const TrackChunk &chunk = game.chunkFor(worldRow);
+        int i = (int)(worldRow % CHUNK_ROWS);
+        int roadLeft = chunk.roadLeft[i];
+        int roadRight = roadLeft + chunk.roadWidth[i] - 1;
+        std::memset(row + 1, OFFROAD_CHAR, (size_t)(roadLeft - 2));
+        std::memset(row + roadRight, OFFROAD_CHAR, (size_t)(width + 1 - roadRight));
+        const WideRowBits &cars = chunk.cars[i];
+        if (chunk.carCount[i]) {
+            for (int x = roadLeft; x <= roadRight; ++x) {
+                if (cars.test(x)) row[x - 1] = OBSTACLE_CHAR;
+            }
+        }
+        if (y == game.viewRows) row[game.playerX - 1] = PLAYER_CHAR;
+    }
+    finishFrame(game.score, game.difficultyLevel, game.playerX - 1);
+}
+
+// --- Main Game ---
+// Plays one game of either type (GameState or EnduranceGame)
+template <typename Game>
+void gameLoop(Game &game, uint64_t seed) {
+    game.rng.seed(seed);
+    game.reset(settings.difficultyLevel);
+
+    Replay replay;
+    replay.seed = seed;
+    replay.level = game.difficultyLevel;
+    replay.mode = Game::REPLAY_MODE;
+    replay.width = game.columns() - 2;
+    replay.height = game.rows();
+    long long tickCount = 0;
+    // Only kept when recording; reserved so it rarely grows mid-game
+    const bool recording = !recordFile.empty();
+    if (recording) replay.events.reserve(4096);
+
+    std::cout << CLEAR_SCREEN;
+    hideCursor();
+    // Frames bypass std::cout, so anything queued there must go out first
+    std::cout.flush();
+    setFrameSize(game.columns(), game.rows());
+    resetFrontBuffer();
+    beginFrames();
+
+    const std::chrono::milliseconds updateDuration = game.tickDuration();
+    const std::chrono::microseconds frameInterval(maxFps > 0 ? 1000000 / maxFps : 0);
+
+    // Fixed timestep: ticks are due at start + n * updateDuration, and a late
+    // wakeup runs the missed ticks instead of stretching the interval
+    auto nextTickTime = std::chrono::steady_clock::now() + updateDuration;
+    auto lastFrameTime = nextTickTime - updateDuration - frameInterval;
+    frameDirty = true;
+
+    while (!game.gameOver) {
+        if (pollTerminalResize()) repaintAll();
+        {
+            ScopedTimer inputTimer(PHASE_INPUT);
+            // Drain everything that arrived since the last iteration;
+            // repeated presses come out as one event with a count
+            pollInput();
+            InputEvent input;
+            while (!game.gameOver && inputQueue.pop(input)) {
+                switch (keyActions[input.key]) {
+                    case ACTION_LEFT:
+                    case ACTION_RIGHT: {
+                        bool left = keyActions[input.key] == ACTION_LEFT;
+                        for (int i = 0; i < input.repeat; ++i) {
+                            if (!game.movePlayer(left ? -1 : 1)) break;
+                            frameDirty = true;
+                            if (recording) replay.events.push_back({tickCount, left ? REPLAY_LEFT : REPLAY_RIGHT});
+                        }
+                        break;
+                    }
+                    case ACTION_QUIT:
+                        game.gameOver = true;
+                        if (recording) replay.events.push_back({tickCount, REPLAY_QUIT});
+                        break;
+                    case ACTION_TOGGLE_HUD:
+                        if (!profiler.enabled) break;
+                        if (input.repeat % 2) profiler.hudVisible = !profiler.hudVisible;
+                        frameDirty = true;
+                        break;
+                    case ACTION_NONE:
+                        break;
+                }
+            }
+        }
+
+        auto currentTime = std::chrono::steady_clock::now();
+        int ticksRun = 0;
+        while (!game.gameOver && currentTime >= nextTickTime && ticksRun < MAX_CATCHUP_TICKS) {
+            // Same as game.tick(0), split so each half can be timed
+            {
+                ScopedTimer timer(PHASE_UPDATE);
+                game.updateObstacles();
+            }
+            {
+                ScopedTimer timer(PHASE_COLLISION);
+                game.checkCollision();
+            }
+            tickCount++;
+            ticksRun++;
+            nextTickTime += updateDuration;
+            frameDirty = true;
+        }
+        if (currentTime >= nextTickTime) nextTickTime = currentTime + updateDuration;
+
+        if (frameDirty && currentTime - lastFrameTime >= frameInterval) {
+            draw(game);
+            frameDirty = false;
+            lastFrameTime = currentTime;
+        }
+
+        // Sleep until the next tick (or the next allowed frame if one is
+        // pending), waking immediately when a key arrives
+        auto wakeTime = nextTickTime;
+        if (frameDirty && lastFrameTime + frameInterval < wakeTime) {
+            wakeTime = lastFrameTime + frameInterval;
+        }
+        if (inputDecoder.pending() && inputDecoder.escapeDeadline() < wakeTime) {
+            wakeTime = inputDecoder.escapeDeadline();
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (!game.gameOver && wakeTime > now) {
+            waitForInput(std::chrono::duration_cast<std::chrono::microseconds>(wakeTime - now));
+        }
+    }
+    // Show the final position even if the cap held back the last frame
+    if (frameDirty) draw(game);
+    endFrames();
+
+    if (Game::RANKED) saveHighestScore(game.difficultyLevel, game.score);
+    if (recording) {
+        replay.finalTick = tickCount;
+        replay.finalScore = game.score;
+        std::string path = recordPath(recordFile, ++recordedGames);
+        ioWorker.post([path, replay] { saveReplay(path, replay); });
+    }
+}
+
+// --- Track Dispatch ---
+// Runs fn on a standard game of the given size: a compiled-in fixed size
+// when there is one, the runtime-sized game otherwise. fn takes the game
+// by reference (a generic lambda) and returns an int.
+template <typename Fn>
+int withTrackGame(int width, int height, Fn &&fn) {
+    if (width == TRACK_WIDTH && height == SCREEN_HEIGHT) {
+        GameState game;
+        return fn(game);
+    }
+    if (width == 40 && height == 20) {
+        TrackGame<40, 20> game;
+        return fn(game);
+    }
+    if (width == 78 && height == 22) { // fills an 80x24 terminal
+        TrackGame<78, 22> game;
+        return fn(game);
+    }
+    TrackGame<DYNAMIC_SIZE, DYNAMIC_SIZE> game;
+    game.trackWidth = std::min(std::max(width, MIN_TRACK_WIDTH), MAX_TRACK_WIDTH);
+    game.trackHeight = std::min(std::max(height, MIN_VIEW_ROWS), MAX_VIEW_ROWS);
+    return fn(game);
+}
+
+// --- Replay Playback ---
+// Re-runs a recorded game from its seed: in real time, as fast as the
+// terminal allows (--fast), or without a terminal (--headless) to check
+// that the recorded score is reproduced. Returns 0 when the final score
+// matches the recording.
+template <typename Game>
+int playReplay(Game &game, const Replay &replay) {
+    game.rng.seed(replay.seed);
+    game.reset(replay.level);
+
+    const bool visible = !headlessMode;
+    if (visible) {
+        setupTerminal();
+        std::cout << CLEAR_SCREEN;
+        hideCursor();
+        std::cout.flush();
+        setFrameSize(game.columns(), game.rows());
+        resetFrontBuffer();
+        beginFrames();
+        draw(game);
+    }
+
+    const std::chrono::milliseconds updateDuration = game.tickDuration();
+    auto nextTickTime = std::chrono::steady_clock::now() + updateDuration;
+    size_t next = 0;
+    long long tickCount = 0;
+    while (!game.gameOver) {
+        while (next < replay.events.size() && replay.events[next].tick == tickCount) {
+            switch (replay.events[next++].action) {
+                case REPLAY_LEFT: game.movePlayer(-1); break;
+                case REPLAY_RIGHT: game.movePlayer(1); break;
+                case REPLAY_QUIT: game.gameOver = true; break;
+            }
+        }
+        if (game.gameOver || tickCount >= replay.finalTick) break;
+
+        if (visible && pollTerminalResize()) {
+            repaintAll();
+            draw(game);
+        }
+        if (visible && !replayFast) {
+            // Still let the viewer bail out while waiting for the next tick
+            auto now = std::chrono::steady_clock::now();
+            if (nextTickTime > now) {
+                waitForInput(std::chrono::duration_cast<std::chrono::microseconds>(nextTickTime - now));
+            }
+            KeyCode key = getInputKey();
+            if (key != KEY_NONE && keyActions[key] == ACTION_QUIT) break;
+            if (std::chrono::steady_clock::now() < nextTickTime) continue;
+            nextTickTime += updateDuration;
+        }
+        game.tick(0);
+        tickCount++;
+        if (visible) draw(game);
+    }
+
+    if (visible) {
+        endFrames();
+        restoreTerminal();
+        std::cout << "\n\n";
+    }
+    bool match = game.score == replay.finalScore && tickCount == replay.finalTick;
+    std::cout << "ticks: " << tickCount << " (recorded " << replay.finalTick << ")\n"
+              << "score: " << game.score << " (recorded " << replay.finalScore << ")\n"
+              << "result: " << (match ? "match" : "MISMATCH") << "\n";
+    return match ? 0 : 1;
+}
+
+int runReplay() {
+    Replay replay;
+    if (!loadReplay(replayFile, replay)) {
+        std::cerr << "Could not read replay file: " << replayFile << "\n";
+        return 1;
+    }
+    if (replay.mode == EnduranceGame::REPLAY_MODE) {
+        EnduranceGame game;
+        game.trackWidth = replay.width;
+        game.viewRows = replay.height;
+        return playReplay(game, replay);
+    }
+    return withTrackGame(replay.width, replay.height,
+                         [&](auto &game) { return playReplay(game, replay); });
+}
+
+// --- Headless Simulation ---
+struct SimStats {
+    long long ticks = 0;
+    long long games = 0;      // completed games (crashes)
+    long long bestScore = 0;
+    long long totalScore = 0;
+
+    void merge(const SimStats &other) {
+        ticks += other.ticks;
+        games += other.games;
+        totalScore += other.totalScore;
+        if (other.bestScore > bestScore) bestScore = other.bestScore;
+    }
+};
+
+// Advance one game by the same tick gameLoop() runs, with moves drawn from a
+// separate policy generator. A game over starts a new game on the next tick.
+// With render set every tick is also drawn, as in the game loop, but the
+// frames are thrown away; that uses the shared frame buffers, so only one
+// thread may render.
+void simulate(GameState &game, Rng &policy, long long ticks, SimStats &stats, bool render = false) {
+    for (long long tick = 0; tick < ticks; ++tick) {
+        game.tick(policy.below(3) - 1);
+        if (render) {
+            draw(game);
+        }
+        if (game.gameOver) {
+            stats.games++;
+            stats.totalScore += game.score;
+            if (game.score > stats.bestScore) stats.bestScore = game.score;
+            game.reset(game.difficultyLevel);
+        }
+    }
+    stats.ticks += ticks;
+}
+
+void printStats(const SimStats &stats, double seconds) {
+    double ticksPerSec = seconds > 0 ? stats.ticks / seconds : 0.0;
+    double nsPerTick = stats.ticks > 0 ? seconds * 1e9 / stats.ticks : 0.0;
+    std::cout << "ticks: " << stats.ticks << "\n"
+              << "games: " << stats.games << "\n"
+              << "best_score: " << stats.bestScore << "\n"
+              << "mean_score: " << (stats.games > 0 ? (double)stats.totalScore / stats.games : 0.0) << "\n"
+              << "seconds: " << seconds << "\n"
+              << "ticks_per_sec: " << std::fixed << std::setprecision(0) << ticksPerSec << "\n"
+              << "ns_per_tick: " << std::setprecision(2) << nsPerTick << "\n";
+}
+
+// Runs the simulation as fast as possible and reports throughput
+int runHeadless() {
+    GameState game;
+    game.rng.seed(gameSeed);
+    game.reset(settings.difficultyLevel);
+    Rng policy;
+    policy.seed(gameSeed, 1);
+    SimStats stats;
+
+    if (headlessRender) {
+        setFrameSize(game.columns(), game.rows());
+        discardFrames = true;
+        draw(game); // the first frame after a resize is a full one
+    }
+
+    unsigned long long allocsBefore = allocationCount.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    simulate(game, policy, headlessTicks, stats, headlessRender);
+    auto end = std::chrono::steady_clock::now();
+    unsigned long long allocs = allocationCount.load(std::memory_order_relaxed) - allocsBefore;
+
+    std::cout << "seed: " << gameSeed << "\n";
+    printStats(stats, std::chrono::duration<double>(end - start).count());
+    std::cout << "allocations: " << allocs << "\n";
+    if (requireNoAllocs && allocs > 0) {
+        std::cerr << "Steady-state loop allocated " << allocs << " times\n";
+        return 3;
+    }
+    return 0;
+}
+
+// --- Batch Simulation ---
+// Splits [0, count) into chunks dealt round-robin to one deque per worker.
+// Workers pop from the back of their own deque and, once it is empty, steal
+// from the front of the others, so uneven chunks still balance out.
+// fn(worker, begin, end) is called for every chunk; returns the steal count.
+long long parallelFor(size_t count, size_t chunk, int threads,
+                      const std::function<void(int, size_t, size_t)> &fn) {
+    struct Range { size_t begin, end; };
+    struct WorkQueue { std::mutex lock; std::deque<Range> ranges; };
+
+    std::vector<WorkQueue> queues(threads);
+    int next = 0;
+    for (size_t begin = 0; begin < count; begin += chunk) {
+        queues[next].ranges.push_back({begin, std::min(begin + chunk, count)});
+        next = (next + 1) % threads;
+    }
+
+    std::atomic<long long> steals{0};
+    auto worker = [&](int self) {
+        while (true) {
+            Range r;
+            bool found = false;
+            {
+                std::lock_guard<std::mutex> guard(queues[self].lock);
+                if (!queues[self].ranges.empty()) {
+                    r = queues[self].ranges.back();
+                    queues[self].ranges.pop_back();
+                    found = true;
+                }
+            }
+            for (int i = 1; !found && i < threads; ++i) {
+                WorkQueue &victim = queues[(self + i) % threads];
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if (!victim.ranges.empty()) {
+                    r = victim.ranges.front();
+                    victim.ranges.pop_front();
+                    found = true;
+                    steals.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            // No work is added once started, so empty everywhere means done
+            if (!found) return;
+            fn(self, r.begin, r.end);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; ++t) pool.emplace_back(worker, t);
+    worker(0);
+    for (auto &th : pool) th.join();
+    return steals.load();
+}
+
+// Steps batchGames independent games headlessTicks ticks each across all
+// cores and reports aggregate throughput
+int runBatch() {
+    int threads = batchThreads > 0 ? batchThreads : (int)std::thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+    // Instance i uses streams 2i (spawns) and 2i + 1 (policy) of the seed,
+    // so results do not depend on which worker ran it
+    std::vector<GameState> games(batchGames);
+    for (size_t i = 0; i < games.size(); ++i) {
+        games[i].rng.seed(gameSeed, 2 * i);
+        games[i].reset(settings.difficultyLevel);
+    }
+    std::vector<SimStats> perWorker(threads);
+
+    const size_t chunk = 16;
+    auto start = std::chrono::steady_clock::now();
+    long long steals = parallelFor(games.size(), chunk, threads,
+        [&](int worker, size_t begin, size_t end) {
+            // Accumulate locally: adjacent per-worker stats share cache lines
+            SimStats local;
+            for (size_t i = begin; i < end; ++i) {
+                Rng policy;
+                policy.seed(gameSeed, 2 * i + 1);
+                simulate(games[i], policy, headlessTicks, local);
+            }
+            perWorker[worker].merge(local);
+        });
+    auto end = std::chrono::steady_clock::now();
+
+    SimStats total;
+    for (const auto &stats : perWorker) total.merge(stats);
+    std::cout << "seed: " << gameSeed << "\n"
+              << "instances: " << batchGames << "\n"
+              << "threads: " << threads << "\n"
+              << "steals: " << steals << "\n";
+    printStats(total, std::chrono::duration<double>(end - start).count());
+    return 0;
+}
+
+// --- Difficulty Tuning ---
+// --tune plays tuneGames headless games of the classic track for every
+// combination of level, bot policy and spawn parameters, spread over all
+// cores with parallelFor(), and prints one CSV row per combination: the mean
+// survival time and a histogram of it in doubling buckets of seconds.
+//
+// Levels only change the tick length, so bots that think in ticks play
+// every level alike. The "human" bot thinks in milliseconds instead: it
+// reacts to a car HUMAN_REACTION_MS late and steps at most once per
+// HUMAN_REPEAT_MS, so faster levels give it fewer moves per row.
+enum BotPolicy { BOT_RANDOM, BOT_DODGE, BOT_HUMAN, BOT_COUNT };
+const char *const BOT_NAMES[BOT_COUNT] = {"random", "dodge", "human"};
+const int HUMAN_REACTION_MS = 250;
+const int HUMAN_REPEAT_MS = 70;
+const int HUMAN_MAX_DELAY = 16;     // reaction ticks a human bot can lag by
+const int TUNE_MAX_SECONDS = 600;   // a game still going after this is "survived"
+const int TUNE_BUCKETS = 11;        // < 1s, < 2s, < 4s ... < 512s, then the rest
+
+struct TuneCell {
+    int level = 1;
+    BotPolicy bot = BOT_RANDOM;
+    int spawnChance = 3;
+    int spawnGap = 2;
+};
+
+struct TuneResult {
+    long long games = 0;
+    long long survived = 0;         // reached TUNE_MAX_SECONDS
+    double totalSeconds = 0;
+    long long histogram[TUNE_BUCKETS] = {};
+
+    void add(double seconds, bool capped) {
+        games++;
+        survived += capped;
+        totalSeconds += seconds;
+        int bucket = 0;
+        while (bucket < TUNE_BUCKETS - 1 && seconds >= (double)(1 << bucket)) bucket++;
+        histogram[bucket]++;
+    }
+
+    void merge(const TuneResult &other) {
+        games += other.games;
+        survived += other.survived;
+        totalSeconds += other.totalSeconds;
+        for (int b = 0; b < TUNE_BUCKETS; ++b) histogram[b] += other.histogram[b];
+    }
+};
+
+// Column of the car that reaches the player's row in `ahead` ticks, 0 if none
+int carArriving(const GameState &game, int ahead) {
+    const int y = game.height() - ahead;
+    for (int i = 0; i < game.obstacleCount; ++i) {
+        int s = game.slot(i);
+        if (game.screenY(s) == y) return game.carX[s];
+    }
+    return 0;
+}
+
+// Step out of column x if the car arriving in `ahead` ticks is in it:
+// towards the middle, or away from the wall
+int dodgeFrom(const GameState &game, int x, int ahead) {
+    if (carArriving(game, ahead) != x) return 0;
+    int dir = x > game.width() / 2 + 1 ? -1 : 1;
+    if (x + dir < 2 || x + dir > game.width() + 1) dir = -dir;
+    return dir;
+}
+
+// A human bot's moves take effect reaction ticks after it decides them
+struct HumanBot {
+    int8_t pending[HUMAN_MAX_DELAY] = {};
+    int next = 0;
+    int delayTicks = 1;
+    int repeatTicks = 1;
+    int sinceMove = 0;
+    int plannedX = 0;               // where the player ends up once pending moves land
+
+    void reset(const GameState &game) {
+        int tickMs = (int)game.tickDuration().count();
+        delayTicks = std::min((HUMAN_REACTION_MS + tickMs - 1) / tickMs, HUMAN_MAX_DELAY);
+        repeatTicks = (HUMAN_REPEAT_MS + tickMs - 1) / tickMs;
+        std::memset(pending, 0, sizeof(pending));
+        next = 0;
+        sinceMove = repeatTicks;
+        plannedX = game.playerX;
+    }
+
+    int move(const GameState &game) {
+        // Plan against the car that arrives when this decision lands
+        int decided = dodgeFrom(game, plannedX, delayTicks + 1);
+        plannedX += decided;
+        int landing = pending[next];
+        pending[next] = (int8_t)decided;
+        next = (next + 1) % delayTicks;
+        sinceMove++;
+        if (landing == 0) return 0;
+        if (sinceMove < repeatTicks) {
+            plannedX -= landing; // the key was not pressed in time
+            return 0;
+        }
+        sinceMove = 0;
+        return landing;
+    }
+};
+
+// One game from reset to crash (or the time cap); returns seconds survived
+double playTuneGame(GameState &game, BotPolicy bot, Rng &policy, bool &capped) {
+    HumanBot human;
+    human.reset(game);
+    const int tickMs = (int)game.tickDuration().count();
+    const long long maxTicks = TUNE_MAX_SECONDS * 1000LL / tickMs;
+    long long ticks = 0;
+    while (!game.gameOver && ticks < maxTicks) {
+        int move = 0;
+        switch (bot) {
+            case BOT_RANDOM: move = policy.below(3) - 1; break;
+            case BOT_DODGE: move = dodgeFrom(game, game.playerX, 1); break;
+            case BOT_HUMAN: move = human.move(game); break;
+            case BOT_COUNT: break;
+        }
+        game.tick(move);
+        ticks++;
+    }
+    capped = !game.gameOver;
+    return ticks * tickMs / 1000.0;
+}
+
+int runTune() {
+    for (int gap : tuneSpawnGaps) {
+        if (gap < 2 || gap > SCREEN_HEIGHT) {
+            std::cerr << "Spawn gaps must be between 2 and " << SCREEN_HEIGHT << "\n";
+            return 2;
+        }
+    }
+    std::vector<TuneCell> cells;
+    for (int level = 1; level <= 5; ++level) {
+        for (int bot = 0; bot < BOT_COUNT; ++bot) {
+            for (int chance : tuneSpawnChances) {
+                for (int gap : tuneSpawnGaps) cells.push_back({level, (BotPolicy)bot, chance, gap});
+            }
+        }
+    }
+    int threads = batchThreads > 0 ? batchThreads : (int)std::thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+    std::vector<TuneResult> perWorker((size_t)threads * cells.size());
+
+    // Game g of every combination uses streams 2g and 2g + 1, so all
+    // combinations see the same spawn dice and results do not depend on
+    // which worker ran them
+    const size_t total = cells.size() * (size_t)tuneGames;
+    auto start = std::chrono::steady_clock::now();
+    parallelFor(total, 64, threads, [&](int worker, size_t begin, size_t end) {
+        GameState game;
+        Rng policy;
+        for (size_t i = begin; i < end; ++i) {
+            size_t c = i / tuneGames;
+            uint64_t g = i % tuneGames;
+            const TuneCell &cell = cells[c];
+            game.spawnChance = cell.spawnChance;
+            game.spawnGap = cell.spawnGap;
+            game.rng.seed(gameSeed, 2 * g);
+            game.reset(cell.level);
+            policy.seed(gameSeed, 2 * g + 1);
+            bool capped = false;
+            double seconds = playTuneGame(game, cell.bot, policy, capped);
+            perWorker[(size_t)worker * cells.size() + c].add(seconds, capped);
+        }
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "# seed " << gameSeed << ", " << tuneGames << " games per row, " << threads
+              << " threads, " << std::fixed << std::setprecision(2) << seconds << " s\n"
+              << "level,bot,spawn_chance,spawn_gap,games,survived,mean_s";
+    for (int b = 0; b < TUNE_BUCKETS - 1; ++b) std::cout << ",lt" << (1 << b) << "s";
+    std::cout << ",ge" << (1 << (TUNE_BUCKETS - 2)) << "s\n";
+    for (size_t c = 0; c < cells.size(); ++c) {
+        TuneResult result;
+        for (int w = 0; w < threads; ++w) result.merge(perWorker[(size_t)w * cells.size() + c]);
+        const TuneCell &cell = cells[c];
+        std::cout << cell.level << "," << BOT_NAMES[cell.bot] << "," << cell.spawnChance << ","
+                  << cell.spawnGap << "," << result.games << "," << result.survived << ","
+                  << std::setprecision(2) << (result.games ? result.totalSeconds / result.games : 0.0);
+        for (long long count : result.histogram) std::cout << "," << count;
+        std::cout << "\n";
+    }
+    return 0;
+}
+
+// --- Micro-benchmarks ---
+// --bench times each hot path on its own and prints the results as JSON in
+// Google Benchmark's layout (bench_compare.py diffs two such files). Every
+// case runs its body with a growing iteration count until one batch takes
+// BENCH_MIN_NS, then BENCH_REPEATS batches of that size; the median batch
+// gives the time per iteration.
+const long long BENCH_MIN_NS = 100000000;
+const int BENCH_REPEATS = 5;
+const uint64_t BENCH_SEED = 1; // without --seed, so two runs time the same work
+volatile uint64_t benchSink = 0; // results go here so nothing is optimized away
+
+struct BenchResult {
+    std::string name;
+    long long iterations;
+    double nsPerIteration;
+};
+
+template <typename Fn>
+void runBench(std::vector<BenchResult> &results, const std::string &name, Fn &&body) {
+    if (!benchFilter.empty() && name.find(benchFilter) == std::string::npos) return;
+    std::cerr << name << "..." << std::flush;
+    long long iterations = 1;
+    while (true) {
+        long long start = nowNs();
+        body(iterations);
+        if (nowNs() - start >= BENCH_MIN_NS || iterations >= (1LL << 40)) break;
+        iterations *= 4;
+    }
+    double samples[BENCH_REPEATS];
+    for (double &sample : samples) {
+        long long start = nowNs();
+        body(iterations);
+        sample = (double)(nowNs() - start) / iterations;
+    }
+    std::sort(samples, samples + BENCH_REPEATS);
+    results.push_back({name, iterations, samples[BENCH_REPEATS / 2]});
+    std::cerr << " " << std::fixed << std::setprecision(1) << samples[BENCH_REPEATS / 2] << " ns\n";
+}
+
+// Two games of one size some ticks apart, drawn in turn so every frame
+// differs from the last; spawnGap sets how many cars are on the road
+template <typename Game>
+void benchDraw(std::vector<BenchResult> &results, Game &first, const char *density, int spawnGap) {
+    Game second = first;
+    Game *games[2] = {&first, &second};
+    for (int i = 0; i < 2; ++i) {
+        games[i]->spawnGap = spawnGap;
+        games[i]->rng.seed(gameSeed, (uint64_t)i);
+        games[i]->reset(1);
+        for (int t = 0; t < 200 + 7 * i; ++t) {
+            games[i]->tick(0);
+            if (games[i]->gameOver) games[i]->reset(1);
+        }
+    }
+    setFrameSize(first.columns(), first.rows());
+    discardFrames = true;
+    char name[64];
+    std::snprintf(name, sizeof(name), "draw/%dx%d/%s", first.width(), first.height(), density);
+    runBench(results, name, [&](long long n) {
+        for (long long i = 0; i < n; ++i) {
+            draw(*games[i & 1]);
+        }
+        benchSink += frameOut.size();
+    });
+    discardFrames = false;
+}
+
+// Steady-state ticks of one game with the headless random policy
+template <typename Game>
+void benchTick(std::vector<BenchResult> &results, Game &game) {
+    game.rng.seed(gameSeed);
+    game.reset(1);
+    Rng policy;
+    policy.seed(gameSeed, 1);
+    char name[64];
+    std::snprintf(name, sizeof(name), "sim/tick/%dx%d", game.width(), game.height());
+    runBench(results, name, [&](long long n) {
+        for (long long i = 0; i < n; ++i) {
+            game.tick(policy.below(3) - 1);
+            if (game.gameOver) game.reset(1);
+        }
+        benchSink += (uint64_t)game.score;
+    });
+}
+
+// A mix of plain keys, arrows in both cursor modes and function keys
+std::string benchKeyStream() {
+    static const char *const keys[] = {"a", "d", "\033[D", "\033[C", "\033OA", "q", "\033[15~", " "};
+    std::string stream;
+    Rng rng;
+    rng.seed(gameSeed);
+    while (stream.size() < 4096) stream += keys[rng.below(8)];
+    return stream;
+}
+
+int runBenchmarks() {
+    std::vector<BenchResult> results;
+
+    const int densities[2] = {2, 8};
+    const char *const densityNames[2] = {"dense", "sparse"};
+    for (int d = 0; d < 2; ++d) {
+        withTrackGame(TRACK_WIDTH, SCREEN_HEIGHT, [&](auto &game) { benchDraw(results, game, densityNames[d], densities[d]); return 0; });
+        withTrackGame(40, 20, [&](auto &game) { benchDraw(results, game, densityNames[d], densities[d]); return 0; });
+        withTrackGame(78, 22, [&](auto &game) { benchDraw(results, game, densityNames[d], densities[d]); return 0; });
+        withTrackGame(120, 40, [&](auto &game) { benchDraw(results, game, densityNames[d], densities[d]); return 0; });
+    }
+
+    withTrackGame(TRACK_WIDTH, SCREEN_HEIGHT, [&](auto &game) { benchTick(results, game); return 0; });
+    withTrackGame(120, 40, [&](auto &game) { benchTick(results, game); return 0; });
+
+    // The collision kernel on its own, over far more lanes than a game has
+    const int laneCounts[] = {32, 320, 3200, 32000, 100000};
+    for (int lanes : laneCounts) {
+        const int n = (lanes + 31) / 32 * 32;
+        std::vector<int16_t> xs(n), rowsOf(n);
+        Rng rng;
+        rng.seed(gameSeed);
+        for (int i = 0; i < n; ++i) {
+            xs[i] = (int16_t)(rng.below(TRACK_WIDTH) + 2);
+            rowsOf[i] = (int16_t)rng.below(1 << 15);
+        }
+        std::vector<uint32_t> mask(n / 32);
+        runBench(results, "kernel/match_lanes/" + std::to_string(n), [&](long long iters) {
+            for (long long i = 0; i < iters; ++i) {
+                matchLanes(xs.data(), rowsOf.data(), n, (int16_t)(2 + (i & 15)), (int16_t)i, mask.data());
+                benchSink += mask[0];
+            }
+        });
+    }
+
+    // Decoding 4 KB of keys read back from a pipe, per 4 KB. Like the game
+    // loop, the queue is drained after every chunk; a chunk of
+    // INPUT_QUEUE_SIZE bytes holds at most that many keys, so none are dropped.
+    const std::string keys = benchKeyStream();
+    runBench(results, "input/decode_4k", [&](long long n) {
+        InputQueue queue;
+        InputDecoder decoder;
+#ifndef _WIN32
+        int fds[2];
+        if (pipe(fds) != 0) return;
+#endif
+        for (long long i = 0; i < n; ++i) {
+            InputEvent e;
+#ifdef _WIN32
+            for (size_t at = 0; at < keys.size(); at += INPUT_QUEUE_SIZE) {
+                size_t end = std::min(keys.size(), at + INPUT_QUEUE_SIZE);
+                for (size_t k = at; k < end; ++k) decoder.feed(keys[k], queue);
+                while (queue.pop(e)) benchSink += e.key;
+            }
+#else
+            if (write(fds[1], keys.data(), keys.size()) < 0) break;
+            char buf[INPUT_QUEUE_SIZE];
+            size_t left = keys.size();
+            while (left > 0) {
+                ssize_t got = read(fds[0], buf, std::min(left, sizeof(buf)));
+                if (got <= 0) break;
+                for (ssize_t k = 0; k < got; ++k) decoder.feed(buf[k], queue);
+                while (queue.pop(e)) benchSink += e.key;
+                left -= (size_t)got;
+            }
+#endif
+        }
+#ifndef _WIN32
+        close(fds[0]);
+        close(fds[1]);
+#endif
+    });
+
+    // The leaderboard file, through the same calls the game makes
+    const std::string benchFile = LEADERBOARD_FILE + ".bench";
+    Leaderboard saved = leaderboard;
+    clearLeaderboard();
+    for (int level = 1; level <= LEVEL_COUNT; ++level) {
+        for (int i = 0; i < LEADERBOARD_SIZE; ++i) insertScore(level, 10 * (i + 1), "bench", 0);
+    }
+    runBench(results, "highscore/save", [&](long long n) {
+        for (long long i = 0; i < n; ++i) benchSink += saveLeaderboard(leaderboard, benchFile);
+    });
+    runBench(results, "highscore/load", [&](long long n) {
+        for (long long i = 0; i < n; ++i) benchSink += mapLeaderboard(benchFile);
+    });
+    std::remove(benchFile.c_str());
+    leaderboard = saved;
+
+#if defined(CARGAME_SIMD_AVX2)
+    const char *simd = "avx2";
+#elif defined(CARGAME_SIMD_SSE2)
+    const char *simd = "sse2";
+#elif defined(CARGAME_SIMD_NEON)
+    const char *simd = "neon";
+#else
+    const char *simd = "scalar";
+#endif
+    std::cout << "{\n  \"context\": {\"seed\": " << gameSeed << ", \"simd\": \"" << simd
+              << "\", \"repetitions\": " << BENCH_REPEATS << "},\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult &r = results[i];
+        std::cout << (i ? "," : "") << "\n    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+                  << ", \"real_time\": " << std::fixed << std::setprecision(2) << r.nsPerIteration
+                  << ", \"time_unit\": \"ns\"}";
+    }
+    std::cout << "\n  ]\n}\n";
+    return 0;
+}
+
+// --- Agent API ---
+// The C API in cargame.h: a batch of classic games stepped in lockstep,
+// with each game's view exported as a uint8 occupancy grid. Every buffer is
+// allocated once in cargame_create(), so bindings can map them without
+// copying and stepping never allocates.
+struct cargame_batch {
+    std::vector<GameState> games;
+    std::vector<uint8_t> observations;
+    std::vector<int32_t> rewards;
+    std::vector<uint8_t> dones;
+    std::vector<int64_t> scores;
+    uint64_t seed = 0;
+    std::vector<uint64_t> episodes;   // games finished per slot
+};
+
+const int AGENT_ROWS = SCREEN_HEIGHT;
+const int AGENT_COLS = TRACK_WIDTH;
+
+void observeGame(const GameState &game, uint8_t *cells) {
+    std::memset(cells, CARGAME_CELL_ROAD, (size_t)AGENT_ROWS * AGENT_COLS);
+    for (int i = 0; i < game.obstacleCount; ++i) {
+        int s = game.slot(i);
+        int y = game.screenY(s);
+        if (y >= 1 && y <= AGENT_ROWS) cells[(size_t)(y - 1) * AGENT_COLS + game.carX[s] - 2] = CARGAME_CELL_CAR;
+    }
+    cells[(size_t)(AGENT_ROWS - 1) * AGENT_COLS + game.playerX - 2] = CARGAME_CELL_PLAYER;
+}
+
+// Episode e of game i uses stream (e << 32) + i, so restarts never replay
+// a game and no stream depends on the batch size
+void restartAgentGame(cargame_batch &batch, size_t i) {
+    GameState &game = batch.games[i];
+    game.rng.seed(batch.seed, (batch.episodes[i] << 32) + i);
+    game.reset(game.difficultyLevel);
+}
+
+extern "C" {
+
+cargame_batch *cargame_create(int count, int level) {
+    if (count < 1 || level < 1 || level > 5) return nullptr;
+    cargame_batch *batch = new cargame_batch;
+    batch->games.resize((size_t)count);
+    for (GameState &game : batch->games) game.difficultyLevel = level;
+    batch->observations.assign((size_t)count * AGENT_ROWS * AGENT_COLS, CARGAME_CELL_ROAD);
+    batch->rewards.assign((size_t)count, 0);
+    batch->dones.assign((size_t)count, 0);
+    batch->scores.assign((size_t)count, 0);
+    batch->episodes.assign((size_t)count, 0);
+    cargame_reset(batch, 0);
+    return batch;
+}
+
+void cargame_destroy(cargame_batch *batch) {
+    delete batch;
+}
+
+void cargame_reset(cargame_batch *batch, uint64_t seed) {
+    batch->seed = seed;
+    const size_t cells = (size_t)AGENT_ROWS * AGENT_COLS;
+    for (size_t i = 0; i < batch->games.size(); ++i) {
+        batch->episodes[i] = 0;
+        restartAgentGame(*batch, i);
+        batch->rewards[i] = 0;
+        batch->dones[i] = 0;
+        batch->scores[i] = 0;
+        observeGame(batch->games[i], batch->observations.data() + i * cells);
+    }
+}
+
+int cargame_step(cargame_batch *batch, const int8_t *actions) {
+    const size_t cells = (size_t)AGENT_ROWS * AGENT_COLS;
+    int crashed = 0;
+    for (size_t i = 0; i < batch->games.size(); ++i) {
+        GameState &game = batch->games[i];
+        long long before = game.score;
+        game.tick(actions[i] < 0 ? -1 : actions[i] > 0 ? 1 : 0);
+        batch->rewards[i] = (int32_t)(game.score - before);
+        batch->scores[i] = game.score;
+        batch->dones[i] = game.gameOver;
+        if (game.gameOver) {
+            crashed++;
+            batch->episodes[i]++;
+            restartAgentGame(*batch, i);
+        }
+        observeGame(game, batch->observations.data() + i * cells);
+    }
+    return crashed;
+}
+
+const uint8_t *cargame_observations(const cargame_batch *batch) { return batch->observations.data(); }
+int cargame_rows(const cargame_batch *) { return AGENT_ROWS; }
+int cargame_cols(const cargame_batch *) { return AGENT_COLS; }
+int cargame_count(const cargame_batch *batch) { return (int)batch->games.size(); }
+const int32_t *cargame_rewards(const cargame_batch *batch) { return batch->rewards.data(); }
+const uint8_t *cargame_dones(const cargame_batch *batch) { return batch->dones.data(); }
+const int64_t *cargame_scores(const cargame_batch *batch) { return batch->scores.data(); }
+
+} // extern "C"
+
+// --- Network Server ---
+// --serve PORT runs many games in one process on one thread: a non-blocking
+// epoll loop accepts players and spectators over TCP, ticks every live game
+// on its own schedule and sends each client only the cells that changed
+// since the last frame it was sent.
+//
+// The client opens with one message:
+//   'P' level:u8   play a new standard game at level 1..5, then steer with
+//                  'l' and 'r' and quit with 'q'; 'P' again starts another
+//   'S'            spectate the longest-running game, moving on to the next
+//                  one when it ends
+// The server sends a type byte followed by varints:
+//   'H' cols rows gameId   a game is now shown; the client grid is all spaces
+//   'F' tick score runCount, then runCount x (skip length cells): skip cells
+//       are unchanged since the end of the previous run, then `length`
+//       changed cells follow as (repeat, char:u8) pairs
+//   'O' score              the game shown has ended
+// A client that is not draining its socket is sent no frames until it
+// catches up; the next frame then carries everything that changed.
+const int NET_GRID_COLS = TRACK_WIDTH + 2;
+const int NET_GRID_ROWS = SCREEN_HEIGHT;
+const int NET_GRID_CELLS = NET_GRID_COLS * NET_GRID_ROWS;
+const size_t NET_MAX_BACKLOG = 64 * 1024; // queued bytes before frames are skipped
+const int NET_MAX_EVENTS = 256;
+
+int servePort = 0;
+
+// Append the runs that turn `front` into `cells` and update `front` to match.
+// Returns the number of runs.
+int encodeCellDelta(const char *cells, char *front, int count, std::string &out) {
+    int runs = 0;
+    int runEnd = 0;
+    int i = 0;
+    while (i < count) {
+        if (cells[i] == front[i]) { ++i; continue; }
+        int start = i;
+        while (i < count && cells[i] != front[i]) ++i;
+        appendVarint(out, (uint64_t)(start - runEnd));
+        appendVarint(out, (uint64_t)(i - start));
+        for (int c = start; c < i;) {
+            int repeat = 1;
+            while (c + repeat < i && cells[c + repeat] == cells[c]) ++repeat;
+            appendVarint(out, (uint64_t)repeat);
+            out.push_back(cells[c]);
+            c += repeat;
+        }
+        std::memcpy(front + start, cells + start, (size_t)(i - start));
+        runEnd = i;
+        ++runs;
+    }
+    return runs;
+}
+
+#ifdef __linux__
+struct NetGame;
+
+struct NetClient {
+    int fd = -1;
+    bool spectator = false;
+    bool closing = false;
+    bool writeArmed = false;            // EPOLLOUT registered
+    NetGame *game = nullptr;            // game being played or watched
+    std::string in;                     // bytes not parsed yet
+    std::string out;                    // bytes not sent yet, from outPos
+    size_t outPos = 0;
+    char screen[NET_GRID_CELLS];        // grid as the client has it
+};
+
+struct NetGame {
+    int id = 0;
+    GameState state;
+    long long tick = 0;
+    std::chrono::steady_clock::time_point nextTick;
+    NetClient *player = nullptr;
+    std::vector<NetClient *> spectators;
+    bool dirty = true;
+};
+
+struct NetServer {
+    int epollFd = -1;
+    int listenFd = -1;
+    int nextGameId = 1;
+    std::unordered_map<int, std::unique_ptr<NetClient>> clients;
+    std::vector<std::unique_ptr<NetGame>> games;   // oldest first
+    std::vector<NetClient *> idleSpectators;       // waiting for a game
+    std::string runs;                              // scratch for frame encoding
+    char grid[NET_GRID_CELLS];
+
+    void watchWrites(NetClient &c, bool on) {
+        if (c.writeArmed == on) return;
+        epoll_event ev = {};
+        ev.events = EPOLLIN | (on ? (uint32_t)EPOLLOUT : 0u);
+        ev.data.fd = c.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, c.fd, &ev);
+        c.writeArmed = on;
+    }
+
+    void flush(NetClient &c) {
+        while (c.outPos < c.out.size()) {
+            ssize_t n = send(c.fd, c.out.data() + c.outPos, c.out.size() - c.outPos, MSG_NOSIGNAL);
+            if (n > 0) { c.outPos += (size_t)n; continue; }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                watchWrites(c, true);
+                return;
+            }
+            c.closing = true;
+            return;
+        }
+        c.out.clear();
+        c.outPos = 0;
+        watchWrites(c, false);
+    }
+
+    void sendHello(NetClient &c, const NetGame &g) {
+        c.out.push_back('H');
+        appendVarint(c.out, NET_GRID_COLS);
+        appendVarint(c.out, NET_GRID_ROWS);
+        appendVarint(c.out, (uint64_t)g.id);
+        std::memset(c.screen, ' ', sizeof(c.screen));
+    }
+
+    void sendFrame(NetClient &c, const NetGame &g) {
+        if (c.out.size() - c.outPos > NET_MAX_BACKLOG) return;
+        runs.clear();
+        int count = encodeCellDelta(grid, c.screen, NET_GRID_CELLS, runs);
+        if (count == 0) return;
+        c.out.push_back('F');
+        appendVarint(c.out, (uint64_t)g.tick);
+        appendVarint(c.out, (uint64_t)g.state.score);
+        appendVarint(c.out, (uint64_t)count);
+        c.out += runs;
+        flush(c);
+    }
+
+    void present(NetGame &g) {
+        std::memset(grid, ' ', sizeof(grid));
+        composeTrack(g.state, grid, NET_GRID_COLS);
+        if (g.player) sendFrame(*g.player, g);
+        for (NetClient *s : g.spectators) sendFrame(*s, g);
+        g.dirty = false;
+    }
+
+    void spectate(NetClient &c) {
+        if (games.empty()) {
+            c.game = nullptr;
+            idleSpectators.push_back(&c);
+            return;
+        }
+        NetGame &g = *games.front();
+        c.game = &g;
+        g.spectators.push_back(&c);
+        sendHello(c, g);
+        g.dirty = true;
+    }
+
+    void startGame(NetClient &c, int level) {
+        std::unique_ptr<NetGame> g(new NetGame());
+        g->id = nextGameId++;
+        g->state.rng.seed(gameSeed + (uint64_t)g->id);
+        g->state.reset(std::min(std::max(level, 1), LEVEL_COUNT));
+        g->nextTick = std::chrono::steady_clock::now() + g->state.tickDuration();
+        g->player = &c;
+        c.game = g.get();
+        sendHello(c, *g);
+        games.push_back(std::move(g));
+        std::vector<NetClient *> waiting;
+        waiting.swap(idleSpectators);
+        for (NetClient *s : waiting) spectate(*s);
+    }
+
+    // Tell everyone the game is over and move its spectators on
+    void endGame(NetGame *g) {
+        std::vector<NetClient *> watchers = g->spectators;
+        if (g->player) watchers.push_back(g->player);
+        for (NetClient *c : watchers) {
+            c->out.push_back('O');
+            appendVarint(c->out, (uint64_t)g->state.score);
+            c->game = nullptr;
+        }
+        if (g->player) flush(*g->player);
+        for (size_t i = 0; i < games.size(); ++i) {
+            if (games[i].get() == g) { games.erase(games.begin() + (long)i); break; }
+        }
+        for (NetClient *s : watchers) {
+            if (s->spectator) spectate(*s);
+            flush(*s);
+        }
+    }
+
+    void handleInput(NetClient &c) {
+        size_t pos = 0;
+        while (pos < c.in.size() && !c.closing) {
+            char cmd = c.in[pos];
+            if (cmd == 'P') {
+                if (pos + 1 >= c.in.size()) break; // level byte still to come
+                if (!c.game && !c.spectator) startGame(c, (uint8_t)c.in[pos + 1]);
+                pos += 2;
+                continue;
+            }
+            ++pos;
+            if (cmd == 'S' && !c.game && !c.spectator) {
+                c.spectator = true;
+                spectate(c);
+            }
+            if (c.spectator || !c.game) continue;
+            NetGame &g = *c.game;
+            if (cmd == 'l' || cmd == 'r') {
+                if (g.state.movePlayer(cmd == 'l' ? -1 : 1)) g.dirty = true;
+            } else if (cmd == 'q') {
+                g.state.gameOver = true;
+            }
+        }
+        c.in.erase(0, pos);
+        if (c.game && c.game->dirty) present(*c.game);
+        if (c.game && c.game->state.gameOver) endGame(c.game);
+        flush(c);
+    }
+
+    void drop(NetClient &c) {
+        if (c.game) {
+            NetGame *g = c.game;
+            if (c.spectator) {
+                g->spectators.erase(std::remove(g->spectators.begin(), g->spectators.end(), &c),
+                                    g->spectators.end());
+            } else {
+                g->player = nullptr;
+                endGame(g);
+            }
+        }
+        idleSpectators.erase(std::remove(idleSpectators.begin(), idleSpectators.end(), &c),
+                             idleSpectators.end());
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, c.fd, nullptr);
+        close(c.fd);
+        clients.erase(c.fd);
+    }
+
+    void acceptClients() {
+        while (true) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;   // EAGAIN: nothing more queued
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+            std::unique_ptr<NetClient> c(new NetClient());
+            c->fd = fd;
+            clients[fd] = std::move(c);
+        }
+    }
+
+    void readClient(NetClient &c) {
+        char buf[512];
+        while (true) {
+            ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+            if (n > 0) { c.in.append(buf, (size_t)n); continue; }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            c.closing = true;   // orderly shutdown or error
+            break;
+        }
+        handleInput(c);
+    }
+
+    // Run every tick that is due, as the game loop does, and send frames
+    void tickGames() {
+        auto now = std::chrono::steady_clock::now();
+        std::vector<NetGame *> over;
+        for (auto &owned : games) {
+            NetGame &g = *owned;
+            const std::chrono::milliseconds interval = g.state.tickDuration();
+            int ticksRun = 0;
+            while (!g.state.gameOver && now >= g.nextTick && ticksRun < MAX_CATCHUP_TICKS) {
+                g.state.tick(0);
+                g.tick++;
+                ticksRun++;
+                g.nextTick += interval;
+                g.dirty = true;
+            }
+            if (now >= g.nextTick) g.nextTick = now + interval;
+            if (g.dirty) present(g);
+            if (g.state.gameOver) over.push_back(&g);
+        }
+        for (NetGame *g : over) endGame(g);
+    }
+
+    int waitMs() const {
+        if (games.empty()) return -1;
+        auto next = games.front()->nextTick;
+        for (const auto &g : games) next = std::min(next, g->nextTick);
+        auto wait = std::chrono::duration_cast<std::chrono::microseconds>(next - std::chrono::steady_clock::now());
+        return wait.count() <= 0 ? 0 : (int)((wait.count() + 999) / 1000);
+    }
+
+    int run(int port) {
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            std::cerr << "Could not create a socket: " << std::strerror(errno) << "\n";
+            return 1;
+        }
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons((uint16_t)port);
+        if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+            listen(listenFd, SOMAXCONN) != 0) {
+            std::cerr << "Could not listen on port " << port << ": " << std::strerror(errno) << "\n";
+            return 1;
+        }
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = listenFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+        std::cout << "Serving Terminal Racer on port " << port << std::endl;
+
+        epoll_event events[NET_MAX_EVENTS];
+        while (true) {
+            int n = epoll_wait(epollFd, events, NET_MAX_EVENTS, waitMs());
+            if (n < 0 && errno != EINTR) break;
+            for (int i = 0; i < n; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd) { acceptClients(); continue; }
+                auto it = clients.find(fd);
+                if (it == clients.end()) continue;
+                NetClient &c = *it->second;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) readClient(c);
+                if (events[i].events & EPOLLOUT) flush(c);
+            }
+            tickGames();
+            std::vector<NetClient *> closing;
+            for (auto &entry : clients) {
+                if (entry.second->closing) closing.push_back(entry.second.get());
+            }
+            for (NetClient *c : closing) drop(*c);
+        }
+        return 1;
+    }
+};
+
+int runServer() {
+    NetServer server;
+    return server.run(servePort);
+}
+#else
+int runServer() {
+    std::cerr << "--serve needs epoll and is only available on Linux.\n";
+    return 1;
+}
+#endif
+
+// --- Game Over ---
+template <int W, int H>
+void showGameOver(const TrackGame<W, H> &game) {
+    showCursor();
+    std::cout << "\n\n  *** GAME OVER ***\n";
+    std::cout << "  Final Score: " << game.score << "\n";
+    if (TrackGame<W, H>::RANKED) {
+        std::cout << "  Highest Score (Level " << game.difficultyLevel << "): "
+                  << highestScore(game.difficultyLevel) << "\n";
+    }
+    std::cout << "\n";
+}
+
+void showGameOver(const EnduranceGame &game) {
+    showCursor();
+    std::cout << "\n\n  *** GAME OVER ***\n";
+    std::cout << "  Final Score: " << game.score << "\n";
+    std::cout << "  Distance: " << game.playerRow() << " rows\n\n";
+}
+
+// --- Scenes ---
+// The menus, a game and the screens between them are states of one loop on
+// the main thread. The terminal stays in raw mode the whole time: menus read
+// their typed answers from the same input queue as the game and echo them
+// themselves, so switching screens costs no termios round trip, and keys
+// typed ahead are left queued for the next scene instead of being lost.
+enum Scene { SCENE_MENU, SCENE_LEVEL_SELECT, SCENE_CONTROLS, SCENE_PLAY, SCENE_PAUSE, SCENE_EXIT };
+
+// A line typed in raw mode, echoed as it is edited
+struct LineInput {
+    char text[16];
+    int len = 0;
+
+    // True once ENTER ends the line
+    bool feed(KeyCode key) {
+        if (key == '\n' || key == '\r') return true;
+        if (key == 0x7F || key == '\b') {
+            if (len > 0) {
+                len--;
+                std::cout << "\b \b" << std::flush;
+            }
+        } else if (key < 256 && isprint((int)key) && len < (int)sizeof(text) - 1) {
+            text[len++] = (char)key;
+            std::cout << (char)key << std::flush;
+        }
+        return false;
+    }
+
+    // The line as a number, 0 when it is not one; clears the line
+    int take() {
+        text[len] = '\0';
+        len = 0;
+        return std::atoi(text);
+    }
+};
+
+struct SceneState {
+    Scene scene = SCENE_MENU;
+    Scene afterPause = SCENE_MENU; // where ENTER leads from SCENE_PAUSE
+    int controlsStep = 0;         // SCENE_CONTROLS: 0 = left key next, 1 = right
+    LineInput line;
+    EnduranceGame endurance;
+    uint64_t nextSeed = 0;
+};
+
+void pauseFor(SceneState &state, Scene next, const char *prompt) {
+    std::cout << prompt << std::flush;
+    state.afterPause = next;
+    state.scene = SCENE_PAUSE;
+}
+
+void drawMenu() {
+    std::cout << CLEAR_SCREEN;
+    gotoxy(2,1);
+    std::cout << "--- TERMINAL RACER MENU ---";
+    gotoxy(4,1);
+    std::cout << "1. New Game (Level: " << settings.difficultyLevel << ")";
+    gotoxy(5,1);
+    std::cout << "2. Select Level (1-5)";
+    gotoxy(6,1);
+    std::cout << "3. Controls (Left: '" << keyToDisplay(settings.moveLeftKey) << "', Right: '" << keyToDisplay(settings.moveRightKey) << "')";
+    gotoxy(7,1);
+    std::cout << "4. Highest Score: " << highestScore(settings.difficultyLevel)
+              << " (Level " << settings.difficultyLevel << " leaderboard)";
+    gotoxy(8,1);
+    std::cout << "5. Exit";
+    gotoxy(10,1);
+    std::cout << "Enter choice (1-5) and press ENTER: " << std::flush;
+}
+
+void drawLeaderboard() {
+    gotoxy(12,1);
+    std::cout << "--- LEVEL " << settings.difficultyLevel << " TOP " << LEADERBOARD_SIZE << " ---";
+    const ScoreEntry *table = leaderboard.entries[settings.difficultyLevel - 1];
+    int shown = 0;
+    for (int i = 0; i < LEADERBOARD_SIZE && table[i].score > 0; ++i, ++shown) {
+        char date[16] = "-";
+        std::time_t when = (std::time_t)table[i].timestamp;
+        if (when > 0) std::strftime(date, sizeof(date), "%Y-%m-%d", std::localtime(&when));
+        gotoxy(13 + i, 1);
+        std::cout << std::setw(2) << (i + 1) << ". " << std::setw(8) << table[i].score
+                  << "  " << std::left << std::setw(PLAYER_NAME_LEN) << table[i].name
+                  << std::right << " " << date;
+    }
+    if (shown == 0) { gotoxy(13, 1); std::cout << "No scores yet."; }
+    gotoxy(14 + std::max(shown, 1), 1);
+}
+
+void drawLevelSelect() {
+    std::cout << CLEAR_SCREEN;
+    gotoxy(SCREEN_HEIGHT/2 - 2, 1);
+    std::cout << "--- SELECT DIFFICULTY ---";
+    gotoxy(SCREEN_HEIGHT/2, 1);
+    std::cout << "Levels: 1 (Easy) to 5 (Hardest). Current: " << settings.difficultyLevel;
+    gotoxy(SCREEN_HEIGHT/2 + 1, 1);
+    std::cout << "Enter new level (1-5) and press ENTER: " << std::flush;
+}
+
+void drawControls() {
+    std::cout << CLEAR_SCREEN;
+    gotoxy(2,1);
+    std::cout << "--- CONTROL CUSTOMIZATION ---\n\n";
+    std::cout << "Current Left Key : " << keyToDisplay(settings.moveLeftKey) << "\n";
+    std::cout << "Current Right Key: " << keyToDisplay(settings.moveRightKey) << "\n\n";
+    std::cout << "Press any key now to set NEW Left control (arrow keys work)." << std::flush;
+}
+
+void enterScene(SceneState &state) {
+    switch (state.scene) {
+        case SCENE_MENU: drawMenu(); break;
+        case SCENE_LEVEL_SELECT: drawLevelSelect(); break;
+        case SCENE_CONTROLS: state.controlsStep = 0; drawControls(); break;
+        default: break;
+    }
+}
+
+// Feed one key press to the current scene
+void handleSceneKey(SceneState &state, KeyCode key) {
+    switch (state.scene) {
+        case SCENE_MENU: {
+            if (!state.line.feed(key)) break;
+            switch (state.line.take()) {
+                case 1: state.scene = SCENE_PLAY; break;
+                case 2: state.scene = SCENE_LEVEL_SELECT; break;
+                case 3: state.scene = SCENE_CONTROLS; break;
+                case 4:
+                    drawLeaderboard();
+                    pauseFor(state, SCENE_MENU, "Press ENTER to return to menu.");
+                    break;
+                case 5: state.scene = SCENE_EXIT; break;
+                default:
+                    gotoxy(12,1);
+                    pauseFor(state, SCENE_MENU, "Invalid choice. Press ENTER to continue...");
+                    break;
+            }
+            break;
+        }
+        case SCENE_LEVEL_SELECT: {
+            if (!state.line.feed(key)) break;
+            int level = state.line.take();
+            if (level >= 1 && level <= 5) settings.difficultyLevel = level;
+            std::cout << "\nLevel set to " << settings.difficultyLevel << ".";
+            pauseFor(state, SCENE_MENU, " Press ENTER to return to menu.");
+            break;
+        }
+        case SCENE_CONTROLS:
+            if (state.controlsStep == 0) {
+                settings.moveLeftKey = key;
+                std::cout << "\n\nLeft key assigned to: " << keyToDisplay(settings.moveLeftKey)
+                          << "\nNow press any key to set NEW Right control (arrow keys work)." << std::flush;
+                state.controlsStep = 1;
+                break;
+            }
+            settings.moveRightKey = key;
+            rebuildKeyActions();
+            std::cout << "\n\nRight key assigned to: " << keyToDisplay(settings.moveRightKey) << "\n\n";
+            std::cout << "Controls Updated! Left: '" << keyToDisplay(settings.moveLeftKey)
+                      << "'  Right: '" << keyToDisplay(settings.moveRightKey) << "'\n\n";
+            pauseFor(state, SCENE_MENU, "Press ENTER to return to the menu...");
+            break;
+        case SCENE_PAUSE:
+            if (key == '\n' || key == '\r') state.scene = state.afterPause;
+            break;
+        default:
+            break;
+    }
+}
+
+// One game, from the menu's settings through the game over screen
+void playScene(SceneState &state) {
+    // The track size is fixed for a game but read again for each one
+    int width = enduranceMode ? customTrackWidth : TRACK_WIDTH;
+    int height = enduranceMode ? customTrackRows : SCREEN_HEIGHT;
+    if (customTrackSize) {
+        width = customTrackWidth;
+        height = customTrackRows;
+    } else if ((fitTrack || enduranceMode) && terminalCols > 0) {
+        width = terminalCols - 2;
+        height = terminalRows - 2;
+    }
+    uint64_t seed = state.nextSeed++;
+    if (enduranceMode) {
+        state.endurance.trackWidth = width;
+        state.endurance.viewRows = height;
+        gameLoop(state.endurance, seed);
+        showGameOver(state.endurance);
+    } else {
+        withTrackGame(width, height, [&](auto &game) {
+            gameLoop(game, seed);
+            showGameOver(game);
+            return 0;
+        });
+    }
+    pauseFor(state, SCENE_MENU, "Press ENTER to return to the main menu...");
+}
+
+// Run scenes until the player picks Exit
+void runScenes() {
+    SceneState state;
+    state.nextSeed = gameSeed;
+    Scene shown = SCENE_EXIT;
+    while (state.scene != SCENE_EXIT) {
+        if (state.scene != shown) {
+            shown = state.scene;
+            if (shown == SCENE_PLAY) {
+                playScene(state);
+                continue;
+            }
+            showCursor();
+            enterScene(state);
+        }
+        pollInput();
+        InputEvent input;
+        // Stop at a scene change; the rest of the queue belongs to the next scene
+        while (state.scene == shown && inputQueue.popOne(input)) handleSceneKey(state, input.key);
+        if (state.scene != shown) continue;
+        auto timeout = std::chrono::microseconds(-1);
+        if (inputDecoder.pending()) {
+            auto now = std::chrono::steady_clock::now();
+            timeout = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::max(inputDecoder.escapeDeadline() - now, std::chrono::steady_clock::duration::zero()));
+        }
+        waitForInput(timeout);
+    }
+}
+
+// --- Command line ---
+bool usage(const char *argv0) {
+    std::cerr << "Usage: " << argv0 << " [--max-fps N] [--headless|--batch G [--threads T]] [--ticks N] [--seed S]\n"
+              << "       " << argv0 << " [--endurance] [--track WxH|fit] [--max-fps N] [--seed S]\n"
+              << "       " << argv0 << " --replay F [--fast|--headless]\n"
+              << "  --max-fps N   cap rendering at N frames per second (0 = uncapped)\n"
+              << "  --headless    run the simulation without a terminal and report throughput\n"
+              << "  --batch G     step G independent games in parallel, --ticks each\n"
+              << "  --threads T   worker threads for --batch and --tune (default: all cores)\n"
+              << "  --bench       time each hot path on its own, JSON on stdout (--bench-filter S)\n"
+              << "  --tune        survival histograms per level, bot and spawn rule, as CSV\n"
+              << "                (--games N per row, --spawn-chance 2,3,5, --spawn-gap 2,3,4)\n"
+              << "  --render      with --headless, also draw every tick (output is discarded)\n"
+              << "  --no-alloc    with --headless, exit with status 3 if the loop allocated\n"
+              << "  --ticks N     number of headless ticks to run (default 1000000)\n"
+              << "  --seed S      random seed for obstacle spawns (default: time)\n"
+              << "  --profile     time each loop phase, HUD toggled in game with 'p'\n"
+              << "  --profile-out F  also dump every sample on exit (CSV, or Chrome trace if F ends in .json)\n"
+              << "  --endurance   play on a large generated track with curves and lanes of traffic\n"
+              << "  --track WxH   track size, " << MIN_TRACK_WIDTH << "x" << MIN_VIEW_ROWS
+              << " up to " << MAX_TRACK_WIDTH << "x" << MAX_VIEW_ROWS << ", or 'fit' for the terminal\n"
+              << "                (default: 20x20, endurance: fit; only 20x20 is ranked)\n"
+              << "  --sync-render  write frames from the game thread instead of a render thread\n"
+              << "  --double-buffer  Windows console: draw off-screen and flip buffers each frame\n"
+              << "  --serve PORT  host games for network players and spectators (Linux)\n"
+              << "  --name NAME   player name for the leaderboard (default: login name)\n"
+              << "  --record F    write each game to a replay file: F, then F-2, F-3, ...\n"
+              << "  --replay F    play back replay file F (--fast: no delays, --headless: verify only)\n";
+    return false;
+}
+
+// Comma-separated integers, e.g. "2,3,5"; false if any is not one
+bool parseIntList(const char *text, std::vector<int> &out) {
+    std::vector<int> values;
+    const char *p = text;
+    while (*p) {
+        char *end;
+        long value = std::strtol(p, &end, 10);
+        if (end == p || (*end && *end != ',')) return false;
+        values.push_back((int)value);
+        p = *end ? end + 1 : end;
+    }
+    if (values.empty()) return false;
+    out = values;
+    return true;
+}
+
+// A TCP port, 1..65535, with nothing after the digits
+bool parsePort(const char *text, int &out) {
+    char *end;
+    long value = std::strtol(text, &end, 10);
+    if (end == text || *end || value < 1 || value > 65535) return false;
+    out = (int)value;
+    return true;
+}
+
+// Returns false (after printing usage) on an unknown or malformed option.
+bool parseArgs(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--max-fps" && i + 1 < argc) {
+            maxFps = std::atoi(argv[++i]);
+            if (maxFps < 0) maxFps = 0;
+        } else if (arg == "--headless") {
+            headlessMode = true;
+        } else if (arg == "--render") {
+            headlessRender = true;
+        } else if (arg == "--no-alloc") {
+            requireNoAllocs = true;
+        } else if (arg == "--ticks" && i + 1 < argc) {
+            headlessTicks = std::atoll(argv[++i]);
+            if (headlessTicks < 0) headlessTicks = 0;
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batchGames = std::atoi(argv[++i]);
+            if (batchGames < 1) batchGames = 1;
+        } else if (arg == "--bench") {
+            benchMode = true;
+        } else if (arg == "--bench-filter" && i + 1 < argc) {
+            benchMode = true;
+            benchFilter = argv[++i];
+        } else if (arg == "--tune") {
+            tuneMode = true;
+        } else if (arg == "--games" && i + 1 < argc) {
+            tuneGames = std::max(std::atoi(argv[++i]), 1);
+        } else if (arg == "--spawn-chance" && i + 1 < argc) {
+            if (!parseIntList(argv[++i], tuneSpawnChances)) return usage(argv[0]);
+        } else if (arg == "--spawn-gap" && i + 1 < argc) {
+            if (!parseIntList(argv[++i], tuneSpawnGaps)) return usage(argv[0]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            batchThreads = std::atoi(argv[++i]);
+            if (batchThreads < 0) batchThreads = 0;
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordFile = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayFile = argv[++i];
+        } else if (arg == "--fast") {
+            replayFast = true;
+        } else if (arg == "--profile") {
+            profiler.enabled = true;
+        } else if (arg == "--profile-out" && i + 1 < argc) {
+            profiler.enabled = true;
+            profiler.outFile = argv[++i];
+        } else if (arg == "--name" && i + 1 < argc) {
+            settings.playerName = argv[++i];
+        } else if (arg == "--sync-render") {
+            syncRender = true;
+        } else if (arg == "--double-buffer") {
+#ifdef _WIN32
+            consoleDoubleBuffer = true;
+#endif
+        } else if (arg == "--serve" && i + 1 < argc && parsePort(argv[i + 1], servePort)) {
+            ++i;
+        } else if (arg == "--endurance") {
+            enduranceMode = true;
+        } else if (arg == "--track" && i + 1 < argc && std::strcmp(argv[i + 1], "fit") == 0) {
+            fitTrack = true;
+            ++i;
+        } else if (arg == "--track" && i + 1 < argc &&
+                   std::sscanf(argv[i + 1], "%dx%d", &customTrackWidth, &customTrackRows) == 2 &&
+                   customTrackWidth >= MIN_TRACK_WIDTH && customTrackWidth <= MAX_TRACK_WIDTH &&
+                   customTrackRows >= MIN_VIEW_ROWS && customTrackRows <= MAX_VIEW_ROWS) {
+            customTrackSize = true;
+            ++i;
+        } else if (arg == "--seed" && i + 1 < argc) {
+            gameSeed = std::strtoull(argv[++i], nullptr, 10);
+            gameSeedSet = true;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    return true;
+}
+
+// --- main ---
+// Left out when main.cpp is built as the agent library (cargame.h)
+#ifndef CARGAME_LIBRARY
+int main(int argc, char **argv) {
+#ifdef _WIN32
+    if (const char *user = std::getenv("USERNAME")) settings.playerName = user;
+#else
+    if (const char *user = std::getenv("USER")) settings.playerName = user;
+#endif
+    if (!parseArgs(argc, argv)) return 2;
+    rebuildKeyActions();
+    if (!gameSeedSet) gameSeed = benchMode ? BENCH_SEED : (uint64_t)std::time(nullptr);
+    if (profiler.enabled) profiler.start();
+    if (!replayFile.empty()) {
+        int rc = runReplay();
+        if (!profiler.outFile.empty()) profiler.dump();
+        return rc;
+    }
+    if (servePort > 0) return runServer();
+    if (tuneMode) return runTune();
+    if (benchMode) return runBenchmarks();
+    if (headlessMode || batchGames > 0) {
+        return batchGames > 0 ? runBatch() : runHeadless();
+    }
+    loadHighestScore();
+    ioWorker.start();
+
+    setupTerminal();
+
+    try {
+        runScenes();
     } catch (...) {
+        endFrames();
         restoreTerminal();
+        bool saved = ioWorker.shutdown(IO_FLUSH_TIMEOUT);
         std::cerr << "\n\nAn unexpected error occurred.\n";
+        if (!saved) std::_Exit(1);
         return 1;
     }
 
     restoreTerminal();
+    if (!profiler.outFile.empty()) {
+        ioWorker.post([] {
+            if (!profiler.dump()) std::cerr << "Could not write profile to " << profiler.outFile << "\n";
+        });
+    }
+    bool saved = ioWorker.shutdown(IO_FLUSH_TIMEOUT);
+    if (!saved) std::cerr << "Some scores or replays may not have been saved (disk too slow).\n";
     std::cout << "\n\nThanks for playing Terminal Racer!\n";
+    if (!saved) {
+        std::cout.flush();
+        std::_Exit(0); // the worker is still writing; see IoWorker::shutdown()
+    }
     return 0;
 }
+#endif // CARGAME_LIBRARY